@@ -0,0 +1,176 @@
+/*
+  ==============================================================================
+
+    Bench.cpp
+    Created: 17 Oct 2026 11:04:36pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#include "Bench.h"
+#include "StutterBuffer.h"
+
+namespace
+{
+    constexpr double sampleRate = 44100.0;
+    constexpr int ringSize = 4 * int(sampleRate);
+
+    //calls body with the number of the pass until minSeconds have gone by, and returns the seconds per call
+    template <typename Body>
+    double timePerCall(double minSeconds, Body&& body)
+    {
+        //one pass first, so the memory is touched before the clock runs
+        body(0);
+
+        const auto start = juce::Time::getHighResolutionTicks();
+        const auto end = start + juce::Time::secondsToHighResolutionTicks(minSeconds);
+        juce::int64 numCalls = 0;
+        juce::int64 now = start;
+
+        while (now < end)
+        {
+            for (int i = 0; i < 64; ++i)
+                body(int(numCalls++));
+            now = juce::Time::getHighResolutionTicks();
+        }
+
+        return juce::Time::highResolutionTicksToSeconds(now - start) / double(numCalls);
+    }
+
+    void fillNoise(juce::AudioBuffer<float>& buffer)
+    {
+        juce::Random random(1234);
+        for (int chan = 0; chan < buffer.getNumChannels(); ++chan)
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                buffer.setSample(chan, i, random.nextFloat() - 0.5f);
+    }
+
+    //the ring write StutterBuffer started out with, one sample at a time and a modulo for every index
+    struct SampleRingWrite
+    {
+        explicit SampleRingWrite(int numChannels) : ring(numChannels, ringSize) { ring.clear(); }
+
+        void write(const juce::AudioBuffer<float>& buf)
+        {
+            for (int chan = ring.getNumChannels(); --chan >= 0;)
+            {
+                int wIndex = ringWriteIndex;
+                for (int i = 0; i < buf.getNumSamples(); i++)
+                {
+                    ring.setSample(chan, wIndex, buf.getSample(chan, i));
+                    wIndex = (wIndex + 1) % ring.getNumSamples();
+                }
+            }
+            ringWriteIndex = (ringWriteIndex + buf.getNumSamples()) % ring.getNumSamples();
+        }
+
+        juce::AudioBuffer<float> ring;
+        int ringWriteIndex = 0;
+    };
+
+    //the ring write of StutterBuffer now, in at most two copies split at the end of the ring
+    struct GroupRingWrite
+    {
+        explicit GroupRingWrite(int numChannels)
+        {
+            const size_t numElements = ChannelGroupBuffer<float>::getNumElements(numChannels, ringSize);
+            arena.reserve(AudioArena::padded(numElements * sizeof(float)));
+            ring.setSize(numChannels, ringSize, arena.allocate<float>(numElements));
+        }
+
+        void write(const juce::AudioBuffer<float>& buf)
+        {
+            for (int done = 0; done < buf.getNumSamples();)
+            {
+                const int numToDo = juce::jmin(buf.getNumSamples() - done, ring.getNumSamples() - ringWriteIndex);
+                ring.copyFrom(buf, done, ringWriteIndex, numToDo);
+                done += numToDo;
+                ringWriteIndex = (ringWriteIndex + numToDo) % ring.getNumSamples();
+            }
+        }
+
+        AudioArena arena;
+        ChannelGroupBuffer<float> ring;
+        int ringWriteIndex = 0;
+    };
+
+    void benchRingWrite(double minSeconds)
+    {
+        std::cout << "ring write, ns per block (old per sample modulo / new chunked copy)\n";
+
+        for (int numChannels : { 1, 2, 8 })
+        {
+            for (int blockSize : { 32, 64, 128, 256, 512, 1024, 2048 })
+            {
+                juce::AudioBuffer<float> block(numChannels, blockSize);
+                fillNoise(block);
+
+                SampleRingWrite before(numChannels);
+                GroupRingWrite after(numChannels);
+
+                const double old = timePerCall(minSeconds, [&](int) { before.write(block); });
+                const double now = timePerCall(minSeconds, [&](int) { after.write(block); });
+
+                std::cout << "  " << numChannels << " ch, block " << blockSize << ": "
+                          << old * 1.0e9 << " / " << now * 1.0e9 << " ns, " << old / now << "x\n";
+            }
+        }
+    }
+
+    //renders a one second loop of the ring at a ratio, in spans of one quantum like StutterBuffer does
+    template <typename Kernel>
+    void benchKernel(const char* name, double minSeconds)
+    {
+        constexpr int spanSize = 32;
+        constexpr int loopLength = int(sampleRate);
+
+        for (int numChannels : { 2, 8 })
+        {
+            juce::AudioBuffer<float> input(numChannels, ringSize);
+            fillNoise(input);
+            GroupRingWrite history(numChannels);
+            history.write(input);
+
+            SpanResampler<Kernel> resampler;
+            resampler.prepare();
+            juce::AudioBuffer<float> output(numChannels, spanSize);
+            const ResamplerSource<float> source{ &history.ring, 0, loopLength - 1 };
+
+            std::cout << "  " << name << ", " << numChannels << " ch:";
+
+            for (double ratio : { 1.0, 0.75, 1.5, 2.0, 0.25, 0.0625 })
+            {
+                const juce::int64 increment = SpanResampler<Kernel>::toPhase(1.0 / ratio);
+                juce::int64 phase = 0;
+
+                const double seconds = timePerCall(minSeconds, [&](int)
+                {
+                    phase = resampler.render(source, output, 0, spanSize, phase, increment, false);
+                    if (phase >= (juce::int64(loopLength) << SpanResampler<Kernel>::fractionBits)) phase = 0;
+                });
+
+                std::cout << " ratio " << ratio << " " << double(spanSize) / seconds * 1.0e-6 << " M";
+            }
+            std::cout << "\n";
+        }
+    }
+
+    void benchResamplers(double minSeconds)
+    {
+        std::cout << "resampler, million output frames per second, every channel of a frame rendered\n";
+        benchKernel<ResamplerKernels::Linear>("linear", minSeconds);
+        benchKernel<ResamplerKernels::Hermite>("hermite", minSeconds);
+        benchKernel<ResamplerKernels::WindowedSinc>("windowed sinc", minSeconds);
+        benchKernel<ResamplerKernels::BandLimitedSinc>("band limited sinc", minSeconds);
+    }
+}
+
+int runBench(const juce::ArgumentList& args)
+{
+    const double minSeconds = args.containsOption("--seconds") ? juce::jmax(0.01, args.getValueForOption("--seconds").getDoubleValue()) : 0.2;
+
+    benchRingWrite(minSeconds);
+    benchResamplers(minSeconds);
+    return 0;
+}
@@ -0,0 +1,16 @@
+/*
+  ==============================================================================
+
+    Bench.h
+    Created: 17 Oct 2026 11:04:36pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+//times the ring write and the resampler kernels of StutterBuffer on their own, over a range of block sizes, ratios and channel counts.
+//returns the exit code of the app
+int runBench(const juce::ArgumentList& args);
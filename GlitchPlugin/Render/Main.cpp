@@ -0,0 +1,245 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Created: 17 Oct 2026 1:14:52pm
+    Author:  laura
+
+    Streams a wav file through GlitchPluginAudioProcessor without a host,
+    following a timeline of parameter changes and midi notes, and reports
+    how fast it rendered. With --regress it checks StutterBuffer against
+    the reference renders in references.txt instead, with --bench it
+    times its parts.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <numeric>
+#include "PluginProcessor.h"
+#include "Regression.h"
+#include "Bench.h"
+
+namespace
+{
+    const char* const usage =
+        "usage: GlitchRender --input in.wav [--output out.wav] [--timeline events.txt]\n"
+        "                    [--block-size 512] [--sample-rate 48000] [--bpm 120]\n"
+        "\n"
+        "timeline lines are '<seconds> <parameter id> <value>', '<seconds> noteOn <note> <velocity>'\n"
+        "or '<seconds> noteOff <note>', values in the units of the parameter. # starts a comment.\n"
+        "\n"
+        "       GlitchRender --regress --references references.txt [--write [--force]] [--tolerance 1e-5]\n"
+        "       GlitchRender --bench [--seconds 0.2]\n";
+
+    //a playhead that is always playing in 4/4 from bar 1 at sample 0, so the processor renders the stutter
+    //and synced sizes and quantized triggers line up with the grid as they would in a host
+    struct RenderPlayHead : public juce::AudioPlayHead
+    {
+        juce::Optional<PositionInfo> getPosition() const override
+        {
+            const double ppq = double(timeInSamples) / sampleRate * bpm / 60.0;
+            const double barStart = std::floor(ppq / 4.0) * 4.0;
+
+            PositionInfo info;
+            info.setIsPlaying(true);
+            info.setBpm(bpm);
+            info.setTimeSignature(TimeSignature{ 4, 4 });
+            info.setTimeInSamples(timeInSamples);
+            info.setTimeInSeconds(double(timeInSamples) / sampleRate);
+            info.setPpqPosition(ppq);
+            info.setPpqPositionOfLastBarStart(barStart);
+            info.setBarCount(juce::int64(barStart / 4.0));
+            return info;
+        }
+
+        double bpm = 120.0;
+        double sampleRate = 44100.0;
+        juce::int64 timeInSamples = 0;
+    };
+
+    struct TimelineEvent
+    {
+        juce::int64 sample;
+        juce::String type;
+        float value;
+        int velocity;
+    };
+
+    //returns false with a message in error if a line can not be read
+    bool parseTimeline(const juce::File& file, double sampleRate, std::vector<TimelineEvent>& events, juce::String& error)
+    {
+        if (!file.existsAsFile()) {
+            error = "could not read " + file.getFullPathName();
+            return false;
+        }
+
+        juce::StringArray lines;
+        file.readLines(lines);
+
+        for (int i = 0; i < lines.size(); ++i)
+        {
+            auto line = lines[i].upToFirstOccurrenceOf("#", false, false).trim();
+            if (line.isEmpty()) continue;
+
+            auto tokens = juce::StringArray::fromTokens(line, true);
+            if (tokens.size() < 3) {
+                error = "timeline line " + juce::String(i + 1) + ": expected '<seconds> <event> <value>'";
+                return false;
+            }
+
+            TimelineEvent event;
+            event.sample = juce::int64(tokens[0].getDoubleValue() * sampleRate + 0.5);
+            event.type = tokens[1];
+            event.value = tokens[2].getFloatValue();
+            event.velocity = tokens.size() > 3 ? tokens[3].getIntValue() : 100;
+            events.push_back(event);
+        }
+
+        std::stable_sort(events.begin(), events.end(), [](const auto& a, const auto& b) { return a.sample < b.sample; });
+        return true;
+    }
+
+    double percentile(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty()) return 0.0;
+        return sorted[juce::jmin(sorted.size() - 1, size_t(p * double(sorted.size() - 1) + 0.5))];
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ArgumentList args(argc, argv);
+
+    if (args.containsOption("--regress"))
+        return runRegression(args);
+
+    if (args.containsOption("--bench"))
+        return runBench(args);
+
+    if (!args.containsOption("--input")) {
+        std::cout << usage;
+        return 1;
+    }
+
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    auto inputFile = args.getFileForOption("--input");
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(inputFile));
+    if (reader == nullptr) {
+        std::cerr << "could not read " << inputFile.getFullPathName() << "\n";
+        return 1;
+    }
+
+    const int blockSize = args.containsOption("--block-size") ? juce::jmax(1, args.getValueForOption("--block-size").getIntValue()) : 512;
+    const double sampleRate = args.containsOption("--sample-rate") ? args.getValueForOption("--sample-rate").getDoubleValue() : reader->sampleRate;
+    const juce::int64 totalSamples = juce::int64(double(reader->lengthInSamples) * sampleRate / reader->sampleRate);
+
+    std::vector<TimelineEvent> events;
+    if (args.containsOption("--timeline")) {
+        juce::String error;
+        if (!parseTimeline(args.getFileForOption("--timeline"), sampleRate, events, error)) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+    }
+
+    //the file is resampled to the render rate on the fly
+    juce::AudioFormatReaderSource readerSource(reader.get(), false);
+    juce::ResamplingAudioSource source(&readerSource, false, int(reader->numChannels));
+    source.setResamplingRatio(reader->sampleRate / sampleRate);
+    source.prepareToPlay(blockSize, sampleRate);
+
+    GlitchPluginAudioProcessor processor;
+    RenderPlayHead playHead;
+    playHead.bpm = args.containsOption("--bpm") ? args.getValueForOption("--bpm").getDoubleValue() : 120.0;
+    playHead.sampleRate = sampleRate;
+    processor.setPlayHead(&playHead);
+
+    const int numChannels = juce::jmax(processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels());
+    processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+    processor.prepareToPlay(sampleRate, blockSize);
+
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    if (args.containsOption("--output")) {
+        auto outputFile = args.getFileForOption("--output");
+        outputFile.deleteFile();
+        juce::WavAudioFormat wav;
+        writer.reset(wav.createWriterFor(new juce::FileOutputStream(outputFile), sampleRate, juce::uint32(numChannels), 24, {}, 0));
+        if (writer == nullptr) {
+            std::cerr << "could not write " << outputFile.getFullPathName() << "\n";
+            return 1;
+        }
+    }
+
+    juce::AudioBuffer<float> buffer(numChannels, blockSize);
+    juce::MidiBuffer midi;
+    auto& parameters = processor.getValueTreeState();
+    size_t nextEvent = 0;
+    std::vector<double> blockTimes;
+    blockTimes.reserve(size_t(totalSamples / blockSize + 1));
+
+    const auto renderStart = juce::Time::getHighResolutionTicks();
+
+    for (juce::int64 position = 0; position < totalSamples; position += blockSize)
+    {
+        const int numSamples = int(juce::jmin(juce::int64(blockSize), totalSamples - position));
+        buffer.setSize(numChannels, numSamples, false, false, true);
+        buffer.clear();
+
+        //a mono file is fed to every channel
+        juce::AudioBuffer<float> fileChannels(buffer.getArrayOfWritePointers(), juce::jmin(numChannels, int(reader->numChannels)), numSamples);
+        source.getNextAudioBlock(juce::AudioSourceChannelInfo(fileChannels));
+        for (int chan = fileChannels.getNumChannels(); chan < numChannels; ++chan)
+            buffer.copyFrom(chan, 0, buffer, 0, 0, numSamples);
+
+        //parameters are read once per block, notes land on their exact sample
+        midi.clear();
+        for (; nextEvent < events.size() && events[nextEvent].sample < position + numSamples; ++nextEvent)
+        {
+            const auto& event = events[nextEvent];
+            const int offset = int(juce::jmax(juce::int64(0), event.sample - position));
+
+            if (event.type == "noteOn")
+                midi.addEvent(juce::MidiMessage::noteOn(1, int(event.value), juce::uint8(juce::jlimit(1, 127, event.velocity))), offset);
+            else if (event.type == "noteOff")
+                midi.addEvent(juce::MidiMessage::noteOff(1, int(event.value)), offset);
+            else if (auto* parameter = parameters.getParameter(event.type))
+                parameter->setValueNotifyingHost(parameter->convertTo0to1(event.value));
+            else
+                std::cerr << "unknown timeline event " << event.type << ", skipped\n";
+        }
+
+        //link group and history length are applied from the message loop, which never runs here
+        processor.applyPendingParameterChanges();
+
+        playHead.timeInSamples = position;
+        const auto blockStart = juce::Time::getHighResolutionTicks();
+        processor.processBlock(buffer, midi);
+        blockTimes.push_back(juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - blockStart));
+
+        if (writer != nullptr)
+            writer->writeFromAudioSampleBuffer(buffer, 0, numSamples);
+    }
+
+    const double renderSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - renderStart);
+    const double processSeconds = std::accumulate(blockTimes.begin(), blockTimes.end(), 0.0);
+    const double audioSeconds = double(totalSamples) / sampleRate;
+    processor.releaseResources();
+
+    std::sort(blockTimes.begin(), blockTimes.end());
+    const double blockSeconds = double(blockSize) / sampleRate;
+
+    std::cout << "rendered " << audioSeconds << " s at " << sampleRate << " Hz in blocks of " << blockSize << " samples\n"
+              << "throughput: " << audioSeconds / juce::jmax(processSeconds, 1.0e-9) << "x real time in processBlock, "
+              << audioSeconds / juce::jmax(renderSeconds, 1.0e-9) << "x including file io\n"
+              << "block time (us): p50 " << percentile(blockTimes, 0.5) * 1.0e6
+              << ", p90 " << percentile(blockTimes, 0.9) * 1.0e6
+              << ", p99 " << percentile(blockTimes, 0.99) * 1.0e6
+              << ", max " << (blockTimes.empty() ? 0.0 : blockTimes.back()) * 1.0e6
+              << " (budget " << blockSeconds * 1.0e6 << ")\n";
+
+    return 0;
+}
@@ -0,0 +1,564 @@
+/*
+  ==============================================================================
+
+    Regression.cpp
+    Created: 17 Oct 2026 2:03:27pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#include <map>
+#include "Regression.h"
+#include "StutterBuffer.h"
+
+namespace
+{
+    constexpr double sampleRate = 44100.0;
+
+    //every render plays one second of signal into the history, triggers the stutter and renders at least one more second
+    constexpr int preRoll = int(sampleRate);
+
+    //what follows the trigger is compared in segments of 20 ms, by their mean, rms, peak and where in the segment
+    //the centre of their energy lies, so a render that is off by a sample shows up as well
+    constexpr int segmentLength = 882;
+    constexpr int minNumSegments = int(sampleRate) / segmentLength;
+    constexpr int valuesPerSegment = 4;
+
+    //the crossfade of StutterBuffer at the end of every repeat, and a few quanta after the last one
+    constexpr int fadeLength = 500;
+    constexpr int tailLength = 4 * 32;
+
+    //the stutter runs in fixed quanta, so every block size has to match the same reference
+    const int blockSizes[] = { 1, 17, 256, 1000 };
+    constexpr int maxBlockSize = 1000;
+    constexpr int referenceBlockSize = 256;
+
+    enum Signal
+    {
+        Impulses,
+        Sine,
+        Noise
+    };
+
+    const char* const signalNames[] = { "impulses", "sine", "noise" };
+
+    //what a case plays besides the plain stutter of the main voice
+    enum Feature
+    {
+        Plain,
+        Surround,
+        Notes,
+        Granular,
+        Linked
+    };
+
+    const char* const featureNames[] = { "", "surround_", "notes_", "granular_", "linked_" };
+
+    struct RegressionCase
+    {
+        Feature feature;
+        Signal signal;
+        float ratio;
+        int repeats;
+        int durationInMs;
+
+        //a linked pair is rendered side by side, the second instance on the channels after the first
+        int getNumChannels() const { return feature == Surround ? 6 : feature == Linked ? 4 : 2; }
+        int getDurationInSamples() const { return int(durationInMs / 1000.0 * sampleRate); }
+
+        //long enough for every repeat, the fade out of the last one and the input it goes back to
+        int getNumSegments() const
+        {
+            const int length = repeats * getDurationInSamples() + fadeLength + tailLength;
+            return juce::jmax(minNumSegments, (length + segmentLength - 1) / segmentLength);
+        }
+        int getRenderLength() const { return preRoll + getNumSegments() * segmentLength; }
+
+        juce::String getName() const
+        {
+            return juce::String(featureNames[feature]) + signalNames[signal] + "_ratio" + juce::String(ratio, 1)
+                 + "_repeats" + juce::String(repeats) + "_" + juce::String(durationInMs) + "ms";
+        }
+    };
+
+    std::vector<RegressionCase> createCases()
+    {
+        std::vector<RegressionCase> cases;
+
+        for (auto signal : { Impulses, Sine, Noise })
+            for (float ratio : { -2.0f, -1.0f, -0.5f, 0.5f, 1.0f, 1.5f, 2.0f })
+                for (int repeats : { 1, 4, 10 })
+                    for (int durationInMs : { 20, 150, 1000 })
+                        cases.push_back({ Plain, signal, ratio, repeats, durationInMs });
+
+        for (auto feature : { Surround, Notes, Granular, Linked })
+            for (auto signal : { Impulses, Noise })
+                cases.push_back({ feature, signal, 1.0f, 4, 150 });
+
+        return cases;
+    }
+
+    //every channel is the one before at half the level, so channel mixups show up.
+    //both precisions get the same samples, the float ones
+    template <typename SampleType>
+    void fillSignal(juce::AudioBuffer<SampleType>& buffer, Signal signal)
+    {
+        juce::Random random(1234);
+        SampleType* first = buffer.getWritePointer(0);
+
+        for (int i = 0; i < buffer.getNumSamples(); ++i)
+        {
+            switch (signal)
+            {
+                case Impulses: first[i] = i % 4410 == 0 ? SampleType(1) : SampleType(0); break;
+                case Sine:     first[i] = SampleType(0.5f * std::sin(juce::MathConstants<float>::twoPi * 440.0f * float(i) / float(sampleRate))); break;
+                case Noise:    first[i] = SampleType(random.nextFloat() - 0.5f); break;
+            }
+        }
+
+        for (int chan = 1; chan < buffer.getNumChannels(); ++chan)
+        {
+            buffer.copyFrom(chan, 0, buffer, chan - 1, 0, buffer.getNumSamples());
+            juce::FloatVectorOperations::multiply(buffer.getWritePointer(chan), SampleType(0.5), buffer.getNumSamples());
+        }
+    }
+
+    //a command at a position of the render
+    struct TimedCommand
+    {
+        int position;
+        StutterCommand command;
+    };
+
+    //the commands of a case after the ratio, sorted by position. the notes case plays two voices next to each other
+    //without the main one, the second one twice as fast and released before the end
+    std::vector<TimedCommand> createCommands(const RegressionCase& test)
+    {
+        if (test.feature != Notes)
+            return { { preRoll, { StutterCommand::Trigger, 0 } } };
+
+        const float duration = float(test.getDurationInSamples());
+
+        StutterCommand first{ StutterCommand::Trigger, 0 };
+        first.voice = 1;
+        first.duration = duration;
+        first.ratio = test.ratio;
+
+        StutterCommand second = first;
+        second.voice = 2;
+        second.ratio = 2.0f * test.ratio;
+
+        StutterCommand release{ StutterCommand::Release, 0 };
+        release.voice = 1;
+
+        return { { preRoll, first }, { preRoll + 10000, second }, { preRoll + 30000, release } };
+    }
+
+    //renders a case in blocks of blockSize, the output replaces the input in place
+    template <typename SampleType>
+    juce::AudioBuffer<SampleType> renderCase(const RegressionCase& test, int blockSize)
+    {
+        const int numInstances = test.feature == Linked ? 2 : 1;
+        const int numChannels = test.getNumChannels() / numInstances;
+        const int renderLength = test.getRenderLength();
+
+        juce::AudioBuffer<SampleType> output(test.getNumChannels(), renderLength);
+        fillSignal(output, test.signal);
+
+        //the pair is fed the same input
+        for (int chan = numChannels; chan < output.getNumChannels(); ++chan)
+            output.copyFrom(chan, 0, output, chan - numChannels, 0, renderLength);
+
+        std::vector<std::unique_ptr<StutterBuffer<SampleType>>> stutters;
+        for (int instance = 0; instance < numInstances; ++instance)
+        {
+            auto stutter = std::make_unique<StutterBuffer<SampleType>>();
+            stutter->setLinkGroup(test.feature == Linked ? 1 : 0);
+            stutter->setMaximumBlockSize(maxBlockSize);
+            stutter->prepareToPlay(numChannels, int(sampleRate), test.getDurationInSamples());
+            stutter->setStutterRepeats(float(test.repeats));
+            stutter->postCommand({ StutterCommand::SetRatio, 0, test.ratio });
+
+            if (test.feature == Granular)
+            {
+                stutter->setGranular(true);
+                stutter->setGrainDensity(40.0f);
+                stutter->setGrainLength(float(0.05 * sampleRate));
+                stutter->setGrainSpray(float(0.02 * sampleRate));
+                stutter->setGrainPitchSpread(3.0f);
+            }
+            stutters.push_back(std::move(stutter));
+        }
+
+        const auto commands = createCommands(test);
+        size_t nextCommand = 0;
+
+        for (int position = 0; position < renderLength; position += blockSize)
+        {
+            const int numSamples = juce::jmin(blockSize, renderLength - position);
+
+            for (; nextCommand < commands.size() && commands[nextCommand].position < position + numSamples; ++nextCommand)
+            {
+                auto command = commands[nextCommand].command;
+                command.sampleOffset = commands[nextCommand].position - position;
+                for (auto& stutter : stutters)
+                    stutter->postCommand(command);
+            }
+
+            for (int instance = 0; instance < numInstances; ++instance)
+            {
+                juce::AudioBuffer<SampleType> block(output.getArrayOfWritePointers() + instance * numChannels, numChannels, position, numSamples);
+                stutters[size_t(instance)]->setBlockPosition(position);
+                stutters[size_t(instance)]->process(block);
+            }
+        }
+
+        return output;
+    }
+
+    //the largest difference of the pre roll to the input, before the trigger the stutter passes the input through
+    template <typename SampleType>
+    double getPreRollDifference(const RegressionCase& test, const juce::AudioBuffer<SampleType>& output)
+    {
+        juce::AudioBuffer<SampleType> input(output.getNumChannels(), preRoll);
+        fillSignal(input, test.signal);
+        if (test.feature == Linked)
+            for (int chan = 2; chan < input.getNumChannels(); ++chan)
+                input.copyFrom(chan, 0, input, chan - 2, 0, preRoll);
+
+        double maxDifference = 0.0;
+        for (int chan = 0; chan < output.getNumChannels(); ++chan)
+            for (int i = 0; i < preRoll; ++i)
+                maxDifference = juce::jmax(maxDifference, std::abs(double(output.getSample(chan, i)) - double(input.getSample(chan, i))));
+
+        return maxDifference;
+    }
+
+    //mean, rms, peak and centre of energy of every segment after the trigger, the centre as a fraction of the segment
+    template <typename SampleType>
+    std::vector<double> createFingerprint(const juce::AudioBuffer<SampleType>& output, int chan)
+    {
+        const int numSegments = (output.getNumSamples() - preRoll) / segmentLength;
+        std::vector<double> fingerprint;
+        fingerprint.reserve(size_t(numSegments * valuesPerSegment));
+        const SampleType* samples = output.getReadPointer(chan, preRoll);
+
+        for (int segment = 0; segment < numSegments; ++segment)
+        {
+            double sum = 0.0, sumOfSquares = 0.0, peak = 0.0, moment = 0.0;
+            for (int i = 0; i < segmentLength; ++i)
+            {
+                const double sample = double(samples[segment * segmentLength + i]);
+                sum += sample;
+                sumOfSquares += sample * sample;
+                peak = juce::jmax(peak, std::abs(sample));
+                moment += double(i) * sample * sample;
+            }
+
+            fingerprint.push_back(sum / segmentLength);
+            fingerprint.push_back(std::sqrt(sumOfSquares / segmentLength));
+            fingerprint.push_back(peak);
+            fingerprint.push_back(sumOfSquares > 0.0 ? moment / sumOfSquares / segmentLength : 0.0);
+        }
+
+        return fingerprint;
+    }
+
+    //fnv-1a over the bytes of every sample of every channel, pre roll included
+    template <typename SampleType>
+    juce::uint64 hashRender(const juce::AudioBuffer<SampleType>& output)
+    {
+        juce::uint64 hash = 14695981039346656037ull;
+        for (int chan = 0; chan < output.getNumChannels(); ++chan)
+        {
+            const auto* bytes = reinterpret_cast<const unsigned char*>(output.getReadPointer(chan));
+            for (size_t i = 0; i < size_t(output.getNumSamples()) * sizeof(SampleType); ++i)
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    juce::String getReferenceKey(const RegressionCase& test, int chan)
+    {
+        return test.getName() + " " + juce::String(chan);
+    }
+
+    juce::String getHashKey(const RegressionCase& test, const char* precision)
+    {
+        return test.getName() + " " + precision;
+    }
+
+    struct References
+    {
+        std::map<juce::String, std::vector<double>> fingerprints;
+        std::map<juce::String, juce::uint64> hashes;
+    };
+
+    //lines are '<case> <channel>' and the fingerprint of that channel, or '<case> float' and '<case> double' and the
+    //hash of the whole render in that precision. # starts a comment
+    bool readReferences(const juce::File& file, References& references)
+    {
+        if (!file.existsAsFile()) return false;
+
+        juce::StringArray lines;
+        file.readLines(lines);
+
+        for (const auto& line : lines)
+        {
+            const auto tokens = juce::StringArray::fromTokens(line.upToFirstOccurrenceOf("#", false, false), true);
+            if (tokens.size() < 2) continue;
+
+            const auto key = tokens[0] + " " + tokens[1];
+            if (tokens[1] == "float" || tokens[1] == "double") {
+                if (tokens.size() == 3)
+                    references.hashes[key] = juce::uint64(tokens[2].getHexValue64());
+                continue;
+            }
+
+            auto& fingerprint = references.fingerprints[key];
+            for (int i = 2; i < tokens.size(); ++i)
+                fingerprint.push_back(tokens[i].getDoubleValue());
+        }
+        return true;
+    }
+
+    bool writeReferences(const juce::File& file, const std::vector<RegressionCase>& cases)
+    {
+        juce::String text;
+        text << "# reference renders of GlitchRender --regress, written with --write at a block size of " << referenceBlockSize << ".\n"
+             << "# '<case> float' and '<case> double' are followed by the hash of the whole render in that precision, for the exact check.\n"
+             << "# '<case> <channel>' is followed by the mean, rms, peak and centre of energy of each " << segmentLength << " samples after\n"
+             << "# the trigger in StutterBuffer<float>, for the check with --tolerance\n";
+
+        for (const auto& test : cases)
+        {
+            const auto output = renderCase<float>(test, referenceBlockSize);
+            text << getHashKey(test, "float") << " " << juce::String::toHexString(juce::int64(hashRender(output))) << "\n"
+                 << getHashKey(test, "double") << " " << juce::String::toHexString(juce::int64(hashRender(renderCase<double>(test, referenceBlockSize)))) << "\n";
+
+            for (int chan = 0; chan < output.getNumChannels(); ++chan)
+            {
+                text << getReferenceKey(test, chan);
+                for (double value : createFingerprint(output, chan))
+                    text << " " << juce::String(value, 8);
+                text << "\n";
+            }
+        }
+
+        return file.replaceWithText(text);
+    }
+
+    //the largest difference of a fingerprint to its reference, or a negative value if there is none to compare with
+    double compareWithReference(const References& references, const juce::String& key, const std::vector<double>& fingerprint)
+    {
+        const auto reference = references.fingerprints.find(key);
+        if (reference == references.fingerprints.end() || reference->second.size() != fingerprint.size())
+            return -1.0;
+
+        double maxDifference = 0.0;
+        for (size_t i = 0; i < fingerprint.size(); ++i)
+            maxDifference = juce::jmax(maxDifference, std::abs(fingerprint[i] - reference->second[i]));
+
+        return maxDifference;
+    }
+
+    //renders a case at every block size it runs at, returns the number of renders that failed.
+    //a negative tolerance asks for the exact render of the references, otherwise the fingerprints are compared
+    template <typename SampleType>
+    int checkCase(const RegressionCase& test, const References& references, double tolerance, const char* precision)
+    {
+        int numFailed = 0;
+
+        for (int blockSize : blockSizes)
+        {
+            const auto output = renderCase<SampleType>(test, blockSize);
+            const auto name = test.getName() + "_block" + juce::String(blockSize) + " " + precision;
+
+            if (tolerance < 0.0) {
+                const auto hash = references.hashes.find(getHashKey(test, precision));
+                if (hash == references.hashes.end()) {
+                    std::cout << "FAIL " << name << ": no reference hash\n";
+                    ++numFailed;
+                }
+                else if (hash->second != hashRender(output)) {
+                    std::cout << "FAIL " << name << ": the render is not the exact reference\n";
+                    ++numFailed;
+                }
+                continue;
+            }
+
+            const double preRollDifference = getPreRollDifference(test, output);
+            if (preRollDifference > tolerance) {
+                std::cout << "FAIL " << name << ": the input before the trigger differs by " << preRollDifference << "\n";
+                ++numFailed;
+                continue;
+            }
+
+            for (int chan = 0; chan < output.getNumChannels(); ++chan)
+            {
+                const double difference = compareWithReference(references, getReferenceKey(test, chan), createFingerprint(output, chan));
+                if (difference < 0.0) {
+                    std::cout << "FAIL " << name << ": no reference for channel " << chan << "\n";
+                    ++numFailed;
+                    break;
+                }
+                if (difference > tolerance) {
+                    std::cout << "FAIL " << name << ": channel " << chan << " differs by " << difference << "\n";
+                    ++numFailed;
+                    break;
+                }
+            }
+        }
+
+        return numFailed;
+    }
+
+    //holds one stutter for ten times as long as the ring of four seconds and checks that its loop still comes from
+    //the newest ring of input at the end, instead of from a window the writer stopped at.
+    //the input is a ramp, so the level of the output tells how old the input it plays is
+    template <typename SampleType>
+    bool checkLongHold()
+    {
+        constexpr int numChannels = 2;
+        const int ringSize = 4 * int(sampleRate);
+        const int length = preRoll + 10 * ringSize;
+        const int blockSize = 512;
+
+        juce::AudioBuffer<SampleType> output(numChannels, length);
+        for (int chan = 0; chan < numChannels; ++chan)
+            for (int i = 0; i < length; ++i)
+                output.setSample(chan, i, SampleType(i) / SampleType(length));
+
+        StutterBuffer<SampleType> stutter;
+        stutter.prepareToPlay(numChannels, int(sampleRate), int(sampleRate));
+        stutter.setStutterRepeats(1000.0f);
+
+        for (int position = 0; position < length; position += blockSize)
+        {
+            const int numSamples = juce::jmin(blockSize, length - position);
+            if (position <= preRoll && preRoll < position + numSamples)
+                stutter.postCommand({ StutterCommand::Trigger, preRoll - position });
+
+            juce::AudioBuffer<SampleType> block(output.getArrayOfWritePointers(), numChannels, position, numSamples);
+            stutter.process(block);
+        }
+
+        //the last second plays a loop that ends in input at most a ring behind
+        const SampleType newest = output.getMagnitude(0, length - int(sampleRate), int(sampleRate));
+        return newest >= SampleType(length - ringSize) / SampleType(length);
+    }
+
+    //prepares an instance while linked, so it has no ring of its own, unlinks it halfway through the pre roll and triggers
+    //right away and then every few blocks. the own ring grows back a chunk at a time on the growth thread, shorter than a loop
+    //at first, so how far it has grown depends on timing. the output has to stay within the level of the input all along
+    template <typename SampleType>
+    bool checkUnlink()
+    {
+        constexpr int numChannels = 2;
+        const int blockSize = 64;
+        const int unlinkBlock = preRoll / 2 / blockSize;
+        const int length = preRoll + 2 * int(sampleRate);
+
+        juce::AudioBuffer<SampleType> output(numChannels, length);
+        fillSignal(output, Sine);
+
+        StutterBuffer<SampleType> stutter;
+        stutter.setLinkGroup(2);
+        stutter.setHistoryLength(10 * int(sampleRate));
+        stutter.prepareToPlay(numChannels, int(sampleRate), int(sampleRate));
+        stutter.setStutterRepeats(1000.0f);
+
+        for (int blockIndex = 0, position = 0; position < length; ++blockIndex, position += blockSize)
+        {
+            const int numSamples = juce::jmin(blockSize, length - position);
+            if (blockIndex == unlinkBlock)
+                stutter.changeLinkGroup(0);
+            if (blockIndex >= unlinkBlock && (blockIndex - unlinkBlock) % 32 == 0)
+                stutter.postCommand({ StutterCommand::Trigger, 0 });
+
+            juce::AudioBuffer<SampleType> block(output.getArrayOfWritePointers(), numChannels, position, numSamples);
+            stutter.setBlockPosition(position);
+            stutter.process(block);
+        }
+
+        for (int chan = 0; chan < numChannels; ++chan)
+            for (int i = 0; i < length; ++i)
+                if (!(std::abs(output.getSample(chan, i)) <= SampleType(0.5)))
+                    return false;
+
+        return true;
+    }
+}
+
+int runRegression(const juce::ArgumentList& args)
+{
+    if (!args.containsOption("--references")) {
+        std::cerr << "usage: GlitchRender --regress --references references.txt [--write [--force]] [--tolerance 1e-5]\n";
+        return 1;
+    }
+
+    const auto file = args.getFileForOption("--references");
+    const auto cases = createCases();
+
+    if (args.containsOption("--write"))
+    {
+        //the references are the expected output, replacing them has to be asked for
+        if (file.exists() && !args.containsOption("--force")) {
+            std::cerr << file.getFullPathName() << " exists, --force replaces it\n";
+            return 1;
+        }
+        if (!writeReferences(file, cases)) {
+            std::cerr << "could not write " << file.getFullPathName() << "\n";
+            return 1;
+        }
+        std::cout << "wrote the references of " << cases.size() << " cases to " << file.getFullPathName() << "\n";
+        return 0;
+    }
+
+    //a missing file fails the check instead of passing it
+    References references;
+    if (!readReferences(file, references)) {
+        std::cout << "FAIL: no references at " << file.getFullPathName() << "\n";
+        return 1;
+    }
+
+    //without --tolerance every render has to be the exact one of its precision. with it, float and double are compared
+    //with the fingerprints float wrote, double to what float rounding adds, so other compilers and platforms can be checked
+    const double tolerance = args.containsOption("--tolerance") ? juce::jmax(0.0, args.getValueForOption("--tolerance").getDoubleValue()) : -1.0;
+    int numRenders = 0;
+    int numFailed = 0;
+
+    for (const auto& test : cases)
+    {
+        numRenders += 2 * juce::numElementsInArray(blockSizes);
+        numFailed += checkCase<float>(test, references, tolerance, "float");
+        numFailed += checkCase<double>(test, references, tolerance, "double");
+    }
+
+    numRenders += 2;
+    if (!checkLongHold<float>()) {
+        std::cout << "FAIL long_hold float: a stutter held past the ring does not recapture the newest input\n";
+        ++numFailed;
+    }
+    if (!checkLongHold<double>()) {
+        std::cout << "FAIL long_hold double: a stutter held past the ring does not recapture the newest input\n";
+        ++numFailed;
+    }
+
+    numRenders += 2;
+    if (!checkUnlink<float>()) {
+        std::cout << "FAIL unlink float: a trigger right after unlinking plays outside the input\n";
+        ++numFailed;
+    }
+    if (!checkUnlink<double>()) {
+        std::cout << "FAIL unlink double: a trigger right after unlinking plays outside the input\n";
+        ++numFailed;
+    }
+
+    if (tolerance < 0.0)
+        std::cout << numRenders - numFailed << " of " << numRenders << " renders match exactly\n";
+    else
+        std::cout << numRenders - numFailed << " of " << numRenders << " renders match within " << tolerance << "\n";
+    return numFailed == 0 ? 0 : 1;
+}
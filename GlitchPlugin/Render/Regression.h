@@ -0,0 +1,20 @@
+/*
+  ==============================================================================
+
+    Regression.h
+    Created: 17 Oct 2026 2:03:27pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+//renders StutterBuffer<float> and StutterBuffer<double> over a grid of synthetic signals, ratios, repeats and durations,
+//and a few cases of more channels, note voices, grains and a linked pair, at several block sizes, until past the last repeat.
+//every render has to hash to the exact render of its case and precision in the references file, references.txt next to
+//this file, or with --tolerance its fingerprint has to be close to the stored one. --write writes that file.
+//also checks that a stutter held for longer than the ring still loops the newest input.
+//returns the exit code of the app, non zero if the references are missing or a render does not match
+int runRegression(const juce::ArgumentList& args);
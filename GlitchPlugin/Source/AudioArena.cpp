@@ -0,0 +1,66 @@
+/*
+  ==============================================================================
+
+    AudioArena.cpp
+    Created: 17 Oct 2026 4:38:12pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#include "AudioArena.h"
+
+#if GLITCH_LOCK_AUDIO_MEMORY
+ #if JUCE_WINDOWS
+  #ifndef NOMINMAX
+   #define NOMINMAX
+  #endif
+  #include <windows.h>
+ #else
+  #include <sys/mman.h>
+ #endif
+#endif
+
+void AudioArena::reserve(size_t numBytes)
+{
+    numBytes = padded(numBytes);
+    if (numBytes <= capacity) return;
+
+    release();
+
+    //the block starts on a page, so it can be locked and handed to the kernel as a whole.
+    //clearing it touches every page here, instead of on the audio thread
+    storage.allocate(numBytes + pageSize, true);
+    data = juce::snapPointerToAlignment(storage.get(), pageSize);
+    capacity = numBytes;
+
+   #if GLITCH_LOCK_AUDIO_MEMORY
+    #if JUCE_WINDOWS
+     VirtualLock(data, capacity);
+    #else
+     #if JUCE_LINUX && defined(MADV_HUGEPAGE)
+      madvise(data, capacity, MADV_HUGEPAGE);
+     #endif
+     mlock(data, capacity);
+    #endif
+   #endif
+}
+
+void AudioArena::release()
+{
+   #if GLITCH_LOCK_AUDIO_MEMORY
+    if (data != nullptr)
+    {
+     #if JUCE_WINDOWS
+      VirtualUnlock(data, capacity);
+     #else
+      munlock(data, capacity);
+     #endif
+    }
+   #endif
+
+    storage.free();
+    data = nullptr;
+    capacity = 0;
+    used = 0;
+}
@@ -0,0 +1,73 @@
+/*
+  ==============================================================================
+
+    AudioArena.h
+    Created: 17 Oct 2026 4:38:12pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+//locks the arena into physical memory and asks linux for huge pages, so the audio thread never page faults on it
+#ifndef GLITCH_LOCK_AUDIO_MEMORY
+ #define GLITCH_LOCK_AUDIO_MEMORY 0
+#endif
+
+//one block of memory that all buffers of a processor are carved from.
+//it only ever grows, so preparing again for the same or a smaller size does not allocate.
+//every carved buffer starts on a cache line, which also covers the alignment of any simd register
+class AudioArena
+{
+public:
+    static constexpr size_t alignment = 64;
+
+    AudioArena() = default;
+    ~AudioArena() { release(); }
+
+    //rounds a buffer size up to the next carving boundary, to add up how much a layout needs
+    static constexpr size_t padded(size_t numBytes) { return (numBytes + alignment - 1) & ~(alignment - 1); }
+
+    //makes room for at least numBytes, everything carved before is lost if the arena has to grow
+    void reserve(size_t numBytes);
+
+    //gives memory back if the arena holds more than numBytes, everything carved before is lost if it does
+    void shrinkTo(size_t numBytes)
+    {
+        if (padded(numBytes) >= capacity) return;
+
+        release();
+        reserve(numBytes);
+    }
+
+    //starts carving from the beginning again, the memory stays allocated
+    void reset() { used = 0; }
+
+    template <typename Type>
+    Type* allocate(size_t count)
+    {
+        const size_t numBytes = padded(count * sizeof(Type));
+        jassert(used + numBytes <= capacity);
+        if (used + numBytes > capacity) return nullptr;
+
+        auto* result = reinterpret_cast<Type*>(data + used);
+        used += numBytes;
+        return result;
+    }
+
+    size_t getCapacity() const { return capacity; }
+
+private:
+    static constexpr size_t pageSize = 4096;
+
+    juce::HeapBlock<char> storage;
+    char* data{ nullptr };
+    size_t capacity{ 0 };
+    size_t used{ 0 };
+
+    void release();
+
+    JUCE_DECLARE_NON_COPYABLE(AudioArena)
+};
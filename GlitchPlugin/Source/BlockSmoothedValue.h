@@ -0,0 +1,67 @@
+/*
+  ==============================================================================
+
+    BlockSmoothedValue.h
+    Created: 17 Oct 2026 11:02:18am
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+//a parameter that ramps linearly to its target over a fixed number of samples.
+//it is read once per processing quantum and stepped with skip, instead of sample by sample,
+//and the ramp does not depend on how the host splits the audio into blocks
+class BlockSmoothedValue
+{
+public:
+    BlockSmoothedValue() = default;
+    explicit BlockSmoothedValue(float initialValue) { reset(initialValue); }
+
+    void setRampLength(int numSamples) { rampLength = juce::jmax(1, numSamples); }
+
+    //jumps straight to value without ramping
+    void reset(float value)
+    {
+        current = target = value;
+        increment = 0.0f;
+        countdown = 0;
+    }
+
+    //starts a new ramp from the current value, setting the same target again leaves a running ramp alone
+    void setTargetValue(float newTarget)
+    {
+        if (juce::approximatelyEqual(newTarget, target)) return;
+
+        target = newTarget;
+        countdown = rampLength;
+        increment = (target - current) / rampLength;
+    }
+
+    float getTargetValue() const { return target; }
+    float getCurrentValue() const { return current; }
+
+    bool isSmoothing() const { return countdown > 0; }
+
+    //advances the ramp by numSamples
+    void skip(int numSamples)
+    {
+        if (numSamples >= countdown)
+        {
+            reset(target);
+            return;
+        }
+
+        current += increment * numSamples;
+        countdown -= numSamples;
+    }
+
+private:
+    float current{ 0.0f };
+    float target{ 0.0f };
+    float increment{ 0.0f };
+    int countdown{ 0 };
+    int rampLength{ 512 };
+};
@@ -0,0 +1,207 @@
+/*
+  ==============================================================================
+
+    ChannelGroupBuffer.h
+    Created: 17 Oct 2026 3:26:40pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+//a multichannel sample buffer that keeps its channels in groups as wide as a simd register,
+//interleaved frame by frame, so a single vector load reads one sample of every channel in a group.
+//channels that pad out the last group stay silent. mono is kept planar and stereo as interleaved pairs instead,
+//so they store no padding and the readers take a scalar path for them.
+//the samples live in chunks of chunkSize frames. the first ones are handed in by setSize, further ones can be
+//allocated on a background thread, one at a time as the audio thread takes them on, without locking on either side
+template <typename SampleType>
+class ChannelGroupBuffer
+{
+public:
+    using Vector = juce::dsp::SIMDRegister<SampleType>;
+    static constexpr int maxGroupWidth = int(Vector::SIMDNumElements);
+
+    static constexpr int chunkBits = 15;
+    static constexpr int chunkSize = 1 << chunkBits;
+
+    //channels per group for a layout, a whole register once there are more channels than a pair
+    static int getGroupWidth(int numChannels) { return numChannels <= 2 ? juce::jlimit(1, maxGroupWidth, numChannels) : maxGroupWidth; }
+    static int getNumGroups(int numChannels) { return (juce::jmax(0, numChannels) + getGroupWidth(numChannels) - 1) / getGroupWidth(numChannels); }
+    static int getNumChunks(int numSamples) { return (juce::jmax(0, numSamples) + chunkSize - 1) / chunkSize; }
+
+    //samples in one chunk, padding channels included
+    static size_t getChunkElements(int numChannels) { return size_t(getNumGroups(numChannels)) * size_t(chunkSize) * size_t(getGroupWidth(numChannels)); }
+
+    //number of samples setSize needs for a layout, numSamples is rounded up to whole chunks
+    static size_t getNumElements(int numChannels, int numSamples) { return size_t(getNumChunks(numSamples)) * getChunkElements(numChannels); }
+
+    //uses memory, which has to hold getNumElements samples and be aligned to a simd register, and clears it.
+    //the buffer does not own that memory. maxNumSamples leaves room to grow up to that size later,
+    //chunks grown before are kept if the layout stays the same. not to be called while the audio thread uses the buffer
+    void setSize(int newNumChannels, int newNumSamples, SampleType* memory, int maxNumSamples = 0)
+    {
+        jassert(juce::snapPointerToAlignment(memory, size_t(Vector::SIMDRegisterSize)) == memory);
+
+        const juce::ScopedLock sl(growthLock);
+
+        const int newNumBaseChunks = getNumChunks(newNumSamples);
+        const int newMaxChunks = juce::jmax(newNumBaseChunks, getNumChunks(maxNumSamples));
+        const bool keepGrownChunks = newNumChannels == numChannels && newNumBaseChunks == numBaseChunks;
+
+        numChannels = juce::jmax(0, newNumChannels);
+        groupWidth = getGroupWidth(numChannels);
+        numGroups = getNumGroups(numChannels);
+        numBaseChunks = newNumBaseChunks;
+
+        if (newMaxChunks > int(grownChunks.size()))
+        {
+            chunks.realloc(size_t(newMaxChunks));
+            grownChunks.resize(size_t(newMaxChunks));
+        }
+        maxChunks = newMaxChunks;
+
+        for (int chunk = 0; chunk < numBaseChunks; ++chunk)
+            chunks[chunk] = memory + size_t(chunk) * getChunkElements(numChannels);
+
+        for (size_t chunk = 0; chunk < grownChunks.size(); ++chunk)
+            if (!keepGrownChunks || int(chunk) < numBaseChunks || int(chunk) >= maxChunks)
+                grownChunks[chunk].free();
+
+        int numAllocated = numBaseChunks;
+        while (numAllocated < maxChunks && grownChunks[size_t(numAllocated)] != nullptr)
+        {
+            chunks[numAllocated] = juce::snapPointerToAlignment(grownChunks[size_t(numAllocated)].get(), size_t(Vector::SIMDRegisterSize));
+            ++numAllocated;
+        }
+
+        numAllocatedChunks.store(numAllocated);
+        targetChunks.store(juce::jmin(targetChunks.load(), maxChunks));
+        numUsedChunks.store(numBaseChunks);
+        clear();
+    }
+
+    void clear()
+    {
+        for (int chunk = 0; chunk < numUsedChunks.load(std::memory_order_relaxed); ++chunk)
+            juce::FloatVectorOperations::clear(chunks[chunk], int(getChunkElements(numChannels)));
+    }
+
+    int getNumChannels() const { return numChannels; }
+    int getNumSamples() const { return numUsedChunks.load(std::memory_order_relaxed) * chunkSize; }
+    int getNumGroups() const { return numGroups; }
+    int getGroupWidth() const { return groupWidth; }
+
+    //true if every frame fills a register and can be read as a vector
+    bool isVectorised() const { return groupWidth == maxGroupWidth; }
+
+    //channels of the group that are not padding
+    int getNumChannelsInGroup(int group) const { return juce::jmin(groupWidth, numChannels - group * groupWidth); }
+
+    //groupWidth samples, aligned to a register if the buffer is vectorised
+    const SampleType* getFrame(int group, int index) const
+    {
+        return chunks[index >> chunkBits] + (size_t(group) * size_t(chunkSize) + size_t(index & (chunkSize - 1))) * size_t(groupWidth);
+    }
+
+    SampleType* getFrame(int group, int index)
+    {
+        return chunks[index >> chunkBits] + (size_t(group) * size_t(chunkSize) + size_t(index & (chunkSize - 1))) * size_t(groupWidth);
+    }
+
+    //interleaves numFrames frames of the planar source into the buffer, without wrapping at the end
+    void copyFrom(const juce::AudioBuffer<SampleType>& source, int sourceStart, int destStart, int numFrames)
+    {
+        jassert(destStart >= 0 && destStart + numFrames <= getNumSamples());
+        const int numSourceChannels = juce::jmin(numChannels, source.getNumChannels());
+
+        //split at the chunk boundaries, inside a chunk every group is contiguous
+        while (numFrames > 0)
+        {
+            const int numToDo = juce::jmin(numFrames, chunkSize - (destStart & (chunkSize - 1)));
+
+            for (int group = 0; group < numGroups; ++group)
+            {
+                SampleType* dest = getFrame(group, destStart);
+                const int firstChannel = group * groupWidth;
+
+                //a planar group is a plain copy
+                if (groupWidth == 1)
+                {
+                    if (firstChannel < numSourceChannels)
+                        juce::FloatVectorOperations::copy(dest, source.getReadPointer(firstChannel, sourceStart), numToDo);
+                    continue;
+                }
+
+                for (int lane = 0; lane < groupWidth; ++lane)
+                {
+                    const int chan = firstChannel + lane;
+                    if (chan >= numSourceChannels) break;
+
+                    const SampleType* in = source.getReadPointer(chan, sourceStart);
+                    for (int i = 0; i < numToDo; ++i)
+                        dest[i * groupWidth + lane] = in[i];
+                }
+            }
+
+            sourceStart += numToDo;
+            destStart += numToDo;
+            numFrames -= numToDo;
+        }
+    }
+
+    //the size the buffer may grow to, rounded up to whole chunks and limited by the maxNumSamples of setSize.
+    //a smaller size does not shrink the buffer before the next setSize
+    void setTargetSize(int numSamples)
+    {
+        const juce::ScopedLock sl(growthLock);
+        targetChunks.store(juce::jmin(getNumChunks(numSamples), maxChunks));
+    }
+
+    //called on the background thread, allocates the next chunk if the target size asks for it and returns true if it did.
+    //stays at most one chunk ahead of the ones in use, so the memory is only taken as the writer gets to it
+    bool allocateChunk()
+    {
+        const juce::ScopedLock sl(growthLock);
+
+        const int chunk = numAllocatedChunks.load();
+        if (chunk >= targetChunks.load() || chunk > numUsedChunks.load(std::memory_order_relaxed)) return false;
+
+        grownChunks[size_t(chunk)].allocate(getChunkElements(numChannels) + size_t(maxGroupWidth), true);
+        chunks[chunk] = juce::snapPointerToAlignment(grownChunks[size_t(chunk)].get(), size_t(Vector::SIMDRegisterSize));
+
+        //publishes the pointer before the count that makes the audio thread use it
+        numAllocatedChunks.store(chunk + 1, std::memory_order_release);
+        return true;
+    }
+
+    //called on the audio thread, appends a chunk the background thread has allocated and returns false if there is none
+    bool grow()
+    {
+        const int numUsed = numUsedChunks.load(std::memory_order_relaxed);
+        if (numUsed >= numAllocatedChunks.load(std::memory_order_acquire)) return false;
+
+        numUsedChunks.store(numUsed + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    //pointers to every chunk, the base chunks point into the memory handed to setSize
+    juce::HeapBlock<SampleType*> chunks;
+    std::vector<juce::HeapBlock<SampleType>> grownChunks;
+
+    int numChannels{ 0 };
+    int groupWidth{ 1 };
+    int numGroups{ 0 };
+    int numBaseChunks{ 0 };
+    int maxChunks{ 0 };
+    //written on the audio thread, the background thread reads it to see how far ahead it is
+    std::atomic<int> numUsedChunks{ 0 };
+    std::atomic<int> numAllocatedChunks{ 0 };
+    std::atomic<int> targetChunks{ 0 };
+
+    //keeps setSize and setTargetSize on the message thread apart from the background thread
+    juce::CriticalSection growthLock;
+};
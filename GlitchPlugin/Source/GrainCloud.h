@@ -0,0 +1,292 @@
+/*
+  ==============================================================================
+
+    GrainCloud.h
+    Created: 17 Oct 2026 9:52:18pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include "SpanResampler.h"
+
+//grain envelopes tabulated over tableSize points, built once and shared by every instance
+struct GrainWindows
+{
+    enum Shape
+    {
+        Hann,
+        Tukey,
+        Expodec,
+        numShapes
+    };
+
+    static constexpr int tableBits = 10;
+    static constexpr int tableSize = 1 << tableBits;
+
+    GrainWindows()
+    {
+        for (int shape = 0; shape < numShapes; ++shape)
+            for (int i = 0; i <= tableSize; ++i)
+                tables[shape][i] = compute(Shape(shape), float(i) / tableSize);
+    }
+
+    //the phase runs from 0 at the start of the grain up to 2^32 at its end
+    float lookup(int shape, juce::uint32 phase) const
+    {
+        constexpr int fractionBits = 32 - tableBits;
+        const juce::uint32 index = phase >> fractionBits;
+        const float alpha = float(phase & ((juce::uint32(1) << fractionBits) - 1)) * (1.0f / float(juce::uint32(1) << fractionBits));
+        const float* table = tables[shape];
+        return table[index] + alpha * (table[index + 1] - table[index]);
+    }
+
+private:
+    static float compute(Shape shape, float x)
+    {
+        const float pi = juce::MathConstants<float>::pi;
+
+        switch (shape)
+        {
+        case Tukey:
+        {
+            //flat in the middle half, raised cosine edges
+            const float edge = juce::jmin(x, 1.0f - x) * 4.0f;
+            return edge >= 1.0f ? 1.0f : 0.5f - 0.5f * std::cos(pi * edge);
+        }
+        case Expodec:
+        {
+            //a short attack and an exponential decay that is pulled down to 0 at the end, for percussive grains
+            if (x < 0.05f) return 0.5f - 0.5f * std::cos(pi * x / 0.05f);
+            const float t = (x - 0.05f) / 0.95f;
+            return std::exp(-4.0f * t) * (1.0f - t);
+        }
+        case Hann:
+        default:
+            return 0.5f - 0.5f * std::cos(2.0f * pi * x);
+        }
+    }
+
+    float tables[numShapes][tableSize + 1];
+};
+
+//asynchronous granular synthesis from a ring history. grains start at random intervals around the mean,
+//each from a random point up to spray samples further back, at a randomly detuned speed and with its own window.
+//the cost is bounded whatever the settings: at most maxActiveGrains play at once and at most maxSpawnsPerQuantum
+//start per quantum of the stutter buffer, grains beyond that are dropped and counted. the budget follows time
+//instead of host blocks, so the same density drops the same grains at any block size. everything runs on the audio thread without
+//locking or allocating, the settings come in by value for every span
+template <typename SampleType>
+class GrainCloud
+{
+public:
+    using Group = ChannelGroupBuffer<SampleType>;
+    using Vector = typename Group::Vector;
+
+    static constexpr int maxActiveGrains = 32;
+    static constexpr int maxSpawnsPerQuantum = 4;
+    static constexpr int maxSpanSize = 32;
+
+    //one group per channel at worst, enough for the 16 channels a stutter buffer takes
+    static constexpr int maxNumGroups = 16;
+    static constexpr int maxGroupWidth = Group::maxGroupWidth;
+
+    //picks one of the windows at random for every grain
+    static constexpr int randomWindow = GrainWindows::numShapes;
+
+    struct Settings
+    {
+        //mean distance between grain starts and mean grain length, in output samples
+        float interval{ 441.0f };
+        float length{ 2205.0f };
+
+        //how much further back than the newest input a grain may start, in input samples
+        float spray{ 0.0f };
+
+        //input samples per output sample, negative plays the grains backwards. each grain is detuned by up to pitchSpread semitones
+        float speed{ 1.0f };
+        float pitchSpread{ 0.0f };
+
+        int window{ GrainWindows::Hann };
+    };
+
+    //the grains are seeded the same way every time, so a render does not depend on when the cloud was created
+    void reset()
+    {
+        for (auto& grain : grains)
+            grain.active = false;
+
+        random.setSeed(0);
+        samplesToNextGrain = 0;
+    }
+
+    //hands out the grain budget of the next quantum
+    void beginQuantum() { numSpawnsLeft = maxSpawnsPerQuantum; }
+
+    //grains that did not fit into the budget since the last call
+    int takeNumDropped() { return std::exchange(numDropped, 0); }
+
+    //renders numSamples of the cloud into dest. getSource(lookback, numFrames) returns the window of the history
+    //that starts lookback samples before its newest input and is numFrames long, in a ring of groupWidth channels per group
+    template <typename SourceFunction>
+    void render(juce::AudioBuffer<SampleType>& dest, int destStart, int numSamples, const Settings& settings, int groupWidth, SourceFunction&& getSource)
+    {
+        jassert(numSamples <= maxSpanSize);
+
+        const int numGroups = juce::jmin(maxNumGroups, (dest.getNumChannels() + groupWidth - 1) / groupWidth);
+        std::fill_n(mix, size_t(numGroups * maxSpanSize * maxGroupWidth), SampleType(0));
+
+        int offset = samplesToNextGrain;
+        for (; offset < numSamples; offset += nextInterval(settings))
+            spawn(offset, numSamples, settings, getSource);
+        samplesToNextGrain = offset - numSamples;
+
+        for (auto& grain : grains)
+            if (grain.active)
+                mixGrain(grain, numGroups, numSamples);
+
+        //deinterleaves the groups into the channels, the padding lanes are left behind
+        for (int group = 0; group < numGroups; ++group)
+        {
+            const int firstChannel = group * groupWidth;
+            const int numLanes = juce::jmin(groupWidth, dest.getNumChannels() - firstChannel);
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const SampleType* frame = getMixFrame(group, i);
+                for (int lane = 0; lane < numLanes; ++lane)
+                    dest.getWritePointer(firstChannel + lane)[destStart + i] = frame[lane];
+            }
+        }
+    }
+
+private:
+    struct Grain
+    {
+        bool active{ false };
+        ResamplerSource<SampleType> source{};
+        juce::int64 phase{ 0 };
+        juce::int64 increment{ 0 };
+        bool reverse{ false };
+        juce::uint32 windowPhase{ 0 };
+        juce::uint32 windowIncrement{ 0 };
+        int window{ 0 };
+        float gain{ 1.0f };
+        int delay{ 0 };
+        int remaining{ 0 };
+    };
+
+    int nextInterval(const Settings& settings)
+    {
+        return juce::jmax(1, int(settings.interval * (0.5f + random.nextFloat())));
+    }
+
+    template <typename SourceFunction>
+    void spawn(int offset, int numSamples, const Settings& settings, SourceFunction& getSource)
+    {
+        Grain* grain = nullptr;
+        for (auto& candidate : grains)
+            if (!candidate.active)
+                grain = &candidate;
+
+        if (grain == nullptr || numSpawnsLeft == 0)
+        {
+            ++numDropped;
+            return;
+        }
+        --numSpawnsLeft;
+
+        const int numFrames = juce::jmax(2, int(settings.length * (0.75f + 0.5f * random.nextFloat())));
+        const double speed = std::abs(settings.speed) * std::exp2(settings.pitchSpread * (2.0f * random.nextFloat() - 1.0f) / 12.0f);
+
+        //a grain starts far enough back to read all of its frames from input that has already been written.
+        //the lookback counts from its offset, so where it reads does not depend on how the host splits the quanta into spans
+        const int numSourceFrames = int(std::ceil(numFrames * speed)) + 2;
+        const int lookback = numSourceFrames + int(settings.spray * random.nextFloat());
+
+        grain->active = true;
+        grain->source = getSource(lookback + numSamples - offset, numSourceFrames);
+        grain->phase = 0;
+        grain->increment = StutterResampler::toPhase(speed);
+        grain->reverse = settings.speed < 0.0f;
+        grain->windowPhase = 0;
+        grain->windowIncrement = juce::uint32((juce::uint64(1) << 32) / juce::uint64(numFrames));
+        grain->window = settings.window == randomWindow ? random.nextInt(GrainWindows::numShapes) : settings.window;
+
+        //overlapping grains add up, the gain keeps the level about the same whatever the density
+        grain->gain = 1.0f / std::sqrt(juce::jmax(1.0f, settings.length / settings.interval));
+        grain->delay = offset;
+        grain->remaining = numFrames;
+    }
+
+    //linear interpolation is enough for grains this short, the read position and window gain are worked out
+    //once per sample and shared by all channels, which are added in a vector per group, or lane by lane for mono and stereo
+    void mixGrain(Grain& grain, int numGroups, int numSamples)
+    {
+        const auto& source = grain.source;
+        const int ringSize = source.ring->getNumSamples();
+        const int numSourceGroups = juce::jmin(numGroups, source.ring->getNumGroups());
+        const juce::int64 lastPhase = juce::int64(source.lastIndex) << StutterResampler::fractionBits;
+        constexpr juce::int64 unity = StutterResampler::unity;
+
+        const int numToDo = juce::jmin(numSamples - grain.delay, grain.remaining);
+
+        for (int i = grain.delay; i < grain.delay + numToDo; ++i)
+        {
+            const juce::int64 position = juce::jlimit(juce::int64(0), lastPhase, grain.reverse ? lastPhase - grain.phase : grain.phase);
+            const int index = int(position >> StutterResampler::fractionBits);
+            const float fraction = float(position & (unity - 1)) * (1.0f / float(unity));
+            const float gain = windows->lookup(grain.window, grain.windowPhase) * grain.gain;
+
+            int first = source.startIndex + index;
+            if (first >= ringSize) first -= ringSize;
+            int second = source.startIndex + juce::jmin(index + 1, source.lastIndex);
+            if (second >= ringSize) second -= ringSize;
+
+            const auto firstWeight = SampleType((1.0f - fraction) * gain);
+            const auto secondWeight = SampleType(fraction * gain);
+
+            for (int group = 0; group < numSourceGroups; ++group)
+            {
+                SampleType* out = getMixFrame(group, i);
+                const SampleType* firstFrame = source.ring->getFrame(group, first);
+                const SampleType* secondFrame = source.ring->getFrame(group, second);
+
+                if (source.ring->isVectorised())
+                {
+                    const auto sum = Vector::fromRawArray(out)
+                                   + Vector::fromRawArray(firstFrame) * firstWeight
+                                   + Vector::fromRawArray(secondFrame) * secondWeight;
+                    sum.copyToRawArray(out);
+                }
+                else
+                {
+                    for (int lane = 0; lane < source.ring->getGroupWidth(); ++lane)
+                        out[lane] += firstFrame[lane] * firstWeight + secondFrame[lane] * secondWeight;
+                }
+            }
+
+            grain.phase += grain.increment;
+            grain.windowPhase += grain.windowIncrement;
+        }
+
+        grain.delay = 0;
+        grain.remaining -= numToDo;
+        if (grain.remaining <= 0)
+            grain.active = false;
+    }
+
+    SampleType* getMixFrame(int group, int index) { return mix + (group * maxSpanSize + index) * maxGroupWidth; }
+
+    juce::SharedResourcePointer<GrainWindows> windows;
+    std::array<Grain, maxActiveGrains> grains;
+    juce::Random random;
+    int samplesToNextGrain{ 0 };
+    int numSpawnsLeft{ maxSpawnsPerQuantum };
+    int numDropped{ 0 };
+
+    //the grains of a span are summed here, a register per frame of a group whatever the width of the ring
+    alignas(Vector::SIMDRegisterSize) SampleType mix[maxNumGroups * maxSpanSize * maxGroupWidth];
+};
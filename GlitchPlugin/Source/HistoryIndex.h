@@ -0,0 +1,76 @@
+/*
+  ==============================================================================
+
+    HistoryIndex.h
+    Created: 17 Oct 2026 8:25:37pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+//positions in the input history where something starts, such as onsets, oldest first.
+//it keeps the newest capacity positions, a new one pushes out the oldest. positions only ever grow,
+//so a lookup is a binary search and the audio thread never has to scan the history itself
+class HistoryIndex
+{
+public:
+    static constexpr int capacity = 1024;
+
+    void clear()
+    {
+        first = 0;
+        numPositions = 0;
+    }
+
+    //position has to be after every position added before
+    void add(juce::int64 position)
+    {
+        jassert(numPositions == 0 || position > get(numPositions - 1));
+
+        if (numPositions == capacity)
+        {
+            positions[size_t(first)] = position;
+            first = (first + 1) & (capacity - 1);
+            return;
+        }
+
+        positions[size_t((first + numPositions) & (capacity - 1))] = position;
+        ++numPositions;
+    }
+
+    //the position closest to target inside [earliest, latest], or -1 if there is none
+    juce::int64 findNearest(juce::int64 target, juce::int64 earliest, juce::int64 latest) const
+    {
+        //the first position at or after target
+        int low = 0, high = numPositions;
+        while (low < high)
+        {
+            const int middle = (low + high) / 2;
+            if (get(middle) < target) low = middle + 1;
+            else high = middle;
+        }
+
+        juce::int64 nearest = -1;
+        for (int i : { low - 1, low })
+        {
+            if (i < 0 || i >= numPositions) continue;
+
+            const juce::int64 position = get(i);
+            if (position < earliest || position > latest) continue;
+            if (nearest < 0 || std::abs(position - target) < std::abs(nearest - target)) nearest = position;
+        }
+        return nearest;
+    }
+
+    int size() const { return numPositions; }
+
+private:
+    juce::int64 get(int i) const { return positions[size_t((first + i) & (capacity - 1))]; }
+
+    std::array<juce::int64, capacity> positions;
+    int first{ 0 };
+    int numPositions{ 0 };
+};
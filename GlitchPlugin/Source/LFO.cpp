@@ -18,25 +18,45 @@ LFO::~LFO()
 {
 }
 
-void LFO::updateLFOState(int bufferSize)
+void LFO::renderBlock(float* dest, int numSamples)
 { 
+    if (numSamples <= 0) return;
 
     if (syncEnabled) {
         freq = syncedFreq();
     }
 
-    float lfoPhaseIncrement = float(juce::MathConstants<float>::twoPi * freq) / (float(this->sampleRate / bufferSize));
-     
-    switch (waveType) {
-        case Sine:     currentValue = (std::sin(phase) / 2.f + 0.5f); break;
-        case Square:   currentValue = phase < juce::MathConstants<float>::pi ? -1.0f : 1.0f; break;
-    }
+    const double twoPi = juce::MathConstants<double>::twoPi;
+    const double phaseIncrement = twoPi * freq / sampleRate;
+
+    //first pass writes the phase of every sample, so the wave shapes below run as plain loops over the block.
+    //the random wave holds a new value per cycle, which is written here directly
+    for (int i = 0; i < numSamples; ++i)
+    {
+        dest[i] = waveType == Random ? heldValue : float(phase);
+        phase += phaseIncrement;
 
-    phase += lfoPhaseIncrement;
+        if (phase >= twoPi) {
+            phase -= twoPi;
+            if (waveType == Random) heldValue = random.nextFloat();
+        }
+    }
 
-    if (phase >= 2 * juce::MathConstants<float>::pi)
-        phase -= 2 * juce::MathConstants<float>::pi;    
+    switch (waveType) {
+        case Sine:
+            //sin(x) = -sin(x - pi), which keeps the argument of the approximation inside [-pi, pi]
+            for (int i = 0; i < numSamples; ++i)
+                dest[i] = 0.5f - juce::dsp::FastMathApproximations::sin(dest[i] - juce::MathConstants<float>::pi) * 0.5f;
+            break;
+        case Square:
+            for (int i = 0; i < numSamples; ++i)
+                dest[i] = dest[i] < juce::MathConstants<float>::pi ? -1.0f : 1.0f;
+            break;
+        case Random:
+            break;
+    }
 
+    currentValue = dest[numSamples - 1];
 }
 
 void LFO::setPhase(double phase)
@@ -64,9 +84,9 @@ void LFO::setBpm(double bpm)
     this->bpm = bpm;
 }
 
-void LFO::toggleSync()
+void LFO::enableSync(bool shouldBeEnabled)
 {
-    syncEnabled = !syncEnabled;
+    this->syncEnabled = shouldBeEnabled;
 }
 
 void LFO::enableLFO(bool shouldBeEnabled)
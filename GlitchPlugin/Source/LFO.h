@@ -27,13 +27,14 @@ public:
         Random
     };
 
-    void updateLFOState(int bufferSize);
+    //renders one lfo value in [0, 1] per sample and advances the phase by numSamples
+    void renderBlock(float* dest, int numSamples);
     void setPhase(double phase);
     void setFreq(double freq);
     void setSampleRate(double sr);
     void setSyncFactor(float factor);
     void setBpm(double bpm);
-    void toggleSync();
+    void enableSync(bool shouldBeEnabled);
     bool syncEnabled = false;
     double syncFactor = 0.5;
 
@@ -48,6 +49,8 @@ private:
     double sampleRate;
     double bpm = 0.0;
     WaveType waveType;
+    juce::Random random;
+    float heldValue = 0.5f;
 
     double syncedFreq();
 };
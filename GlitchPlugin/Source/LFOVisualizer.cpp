@@ -13,57 +13,38 @@
 #include "LFOVisualizer.h"
 
 //==============================================================================
-LFOVisualizer::LFOVisualizer(GlitchPluginAudioProcessor& p, LFO& l) : audioProcessor(p), lfo(l)
+LFOVisualizer::LFOVisualizer(GlitchPluginAudioProcessor& p, LFO& l) : audioProcessor(p), lfo(l),
+    lfoAttachment(p.getValueTreeState(), ParameterIDs::lfoEnabled, lfoToggle),
+    syncAttachment(p.getValueTreeState(), ParameterIDs::lfoSync, syncToggle),
+    frequencyAttachment(p.getValueTreeState(), ParameterIDs::lfoFreq, frequencySlider),
+    syncRateAttachment(p.getValueTreeState(), ParameterIDs::lfoSyncRate, syncSlider)
 {
     // In your constructor, you should add any child components, and
     // initialise any special settings that your component needs.
 
     lfoToggle.setButtonText("LFO On/Off");
-    lfoToggle.setToggleState(false, false);
-    lfoToggle.onClick = [&]()
+    //the attachment sets the toggle state for clicks, automation and state loads alike, so the timer follows every one of them
+    lfoToggle.onStateChange = [&]()
     {
-        enableLFO(); 
+        updateTimer();
     };
+    updateTimer();
     addAndMakeVisible(lfoToggle);
 
     syncToggle.setButtonText("Sync to beat");
-    syncToggle.setToggleState(false, false);
-    syncToggle.onClick = [&]()
-    {
-        toggleSync();
-    };
     addAndMakeVisible(syncToggle);
 
 
-    syncSlider.setRange(-2, 4);
     syncSlider.setNumDecimalPlacesToDisplay(0);
     syncSlider.setSliderStyle(juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag);
     syncSlider.setTextBoxIsEditable(false);
     syncSlider.setTextBoxStyle(juce::Slider::TextEntryBoxPosition::TextBoxBelow, false, 60, 20);
-    syncSlider.textFromValueFunction = [](double value) 
-    {
-            double valueInBeats = pow(2, round(value));
-
-            if (value >= 2) {
-                return juce::String(valueInBeats / 4) + " bars";
-            }
-            return "1 / " + juce::String(4 / valueInBeats);
-    };
-    syncSlider.onValueChange = [&]() 
-    {
-            float factor = 1 / (pow(2, round(syncSlider.getValue())));
-            audioProcessor.getLFO().setSyncFactor(factor);
-    };
-    syncSlider.setValue(1);
     addAndMakeVisible(syncSlider);
     
-    frequencySlider.setRange(0.1, 1.0);
     frequencySlider.setTextValueSuffix("Hz");
-    frequencySlider.setValue(0.5);
     frequencySlider.setNumDecimalPlacesToDisplay(1);
     frequencySlider.setSliderStyle(juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag);
     frequencySlider.setTextBoxStyle(juce::Slider::TextEntryBoxPosition::TextBoxBelow, false, 60, 20);
-    frequencySlider.addListener(this);
     addAndMakeVisible(frequencySlider);
 
     frequencyLabel.setText("Freq", juce::dontSendNotification);
@@ -75,7 +56,6 @@ LFOVisualizer::LFOVisualizer(GlitchPluginAudioProcessor& p, LFO& l) : audioProce
 
 LFOVisualizer::~LFOVisualizer()
 {
-    modDepthSlider.removeListener(this);
 }
 
 void LFOVisualizer::paint (juce::Graphics& g)
@@ -109,31 +89,18 @@ void LFOVisualizer::resized()
     syncSlider.setBounds(syncX, sliderY, 80, 70);
 }
 
-void LFOVisualizer::enableLFO()
+void LFOVisualizer::updateTimer()
 {
-    lfoToggle.setToggleState(!lfoToggle.getToggleState(), false);
-    lfoEnabled = !lfoEnabled;
-    this->audioProcessor.enableLFO(lfoEnabled);
+    //the state callback also fires on hover, only a change of the toggle restarts or stops the timer
+    if (lfoToggle.getToggleState() == isTimerRunning())
+        return;
 
-    if (lfoEnabled) {
+    if (lfoToggle.getToggleState()) {
         startTimerHz(60);
     }
     else {
         stopTimer();
     }
-
-}
-
-void LFOVisualizer::toggleSync()
-{
-    audioProcessor.getLFO().toggleSync();
-}
-
-void LFOVisualizer::sliderValueChanged(juce::Slider* slider)
-{
-    if (slider == &frequencySlider) {
-        lfo.setFreq(slider->getValue());
-    }
 }
 
 void LFOVisualizer::timerCallback()
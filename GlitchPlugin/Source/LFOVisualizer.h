@@ -15,7 +15,7 @@
 //==============================================================================
 /*
 */
-class LFOVisualizer  : public juce::Component , public juce::Timer, public juce::Slider::Listener
+class LFOVisualizer  : public juce::Component , public juce::Timer
 {
 public:
     LFOVisualizer(GlitchPluginAudioProcessor&, LFO&);
@@ -24,13 +24,10 @@ public:
     void paint (juce::Graphics&) override;
     void resized() override;
 
-    void enableLFO();
-    void toggleSync();
+    void updateTimer();
 
     float currentLFOValue{ 0.0f };
 
-    void sliderValueChanged(juce::Slider* slider) override;
-
 private:
 
     void timerCallback() override;
@@ -39,9 +36,7 @@ private:
     float visualizationWidth;
     float visualizationHeight;
     juce::ToggleButton lfoToggle;
-    bool lfoEnabled{ false };
     juce::ToggleButton syncToggle;
-    bool syncEnabled{ false };
 
     juce::Slider modDepthSlider;
     juce::Label modDepthLabel;
@@ -51,6 +46,11 @@ private:
     GlitchPluginAudioProcessor& audioProcessor;
     LFO& lfo;
 
+    juce::AudioProcessorValueTreeState::ButtonAttachment lfoAttachment;
+    juce::AudioProcessorValueTreeState::ButtonAttachment syncAttachment;
+    juce::AudioProcessorValueTreeState::SliderAttachment frequencyAttachment;
+    juce::AudioProcessorValueTreeState::SliderAttachment syncRateAttachment;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LFOVisualizer)
 
 };
@@ -0,0 +1,121 @@
+/*
+  ==============================================================================
+
+    OnsetDetector.h
+    Created: 17 Oct 2026 9:04:16pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include "ChannelGroupBuffer.h"
+
+//finds onsets in the frames of a ring right after they were written, while they are still in the cache.
+//the energy of every hop of hopSize frames is summed a whole channel group per vector, or per sample for the planar
+//and paired layouts of mono and stereo. an onset is a hop whose
+//energy jumps onsetRatio above the slow envelope of the ones before. only that envelope runs per hop,
+//so the cost is a multiply and add per vector and frame
+template <typename SampleType>
+class OnsetDetector
+{
+public:
+    using Vector = typename ChannelGroupBuffer<SampleType>::Vector;
+
+    static constexpr int hopSize = 32;
+    static constexpr float onsetRatio = 4.0f;
+    static constexpr float onsetFloor = 1.0e-4f;
+
+    void prepare(double sampleRate)
+    {
+        const double hopsPerSecond = sampleRate / hopSize;
+        slowCoefficient = float(1.0 - std::exp(-1.0 / (0.1 * hopsPerSecond)));
+        holdoffHops = int(0.05 * hopsPerSecond);
+        reset();
+    }
+
+    void reset()
+    {
+        hopSum = 0.0f;
+        hopFill = 0;
+        slowEnvelope = 0.0f;
+        holdoffRemaining = 0;
+    }
+
+    //analyses numFrames frames of ring from ringIndex on, wrapping at its end, and calls onOnset with the offset
+    //of the first frame of every hop that starts an onset. hops run on across calls, so the offset can be negative
+    template <typename Callback>
+    void process(const ChannelGroupBuffer<SampleType>& ring, int ringIndex, int numFrames, Callback&& onOnset)
+    {
+        const int ringSize = ring.getNumSamples();
+        const int numGroups = ring.getNumGroups();
+        if (ringSize == 0 || numGroups == 0) return;
+        const float scale = 1.0f / float(ring.getNumChannels() * hopSize);
+
+        for (int done = 0; done < numFrames;)
+        {
+            const int numToDo = juce::jmin(numFrames - done, hopSize - hopFill);
+
+            //the padding lanes of the last group are silent, so summing every lane gives the energy of the real channels
+            if (ring.isVectorised())
+            {
+                auto energy = Vector::expand(SampleType(0));
+                for (int frame = 0; frame < numToDo; ++frame)
+                {
+                    int index = ringIndex + done + frame;
+                    if (index >= ringSize) index -= ringSize;
+
+                    for (int group = 0; group < numGroups; ++group)
+                    {
+                        const auto samples = Vector::fromRawArray(ring.getFrame(group, index));
+                        energy += samples * samples;
+                    }
+                }
+                hopSum += float(energy.sum());
+            }
+            else
+            {
+                SampleType energy = 0;
+                for (int frame = 0; frame < numToDo; ++frame)
+                {
+                    int index = ringIndex + done + frame;
+                    if (index >= ringSize) index -= ringSize;
+
+                    for (int group = 0; group < numGroups; ++group)
+                    {
+                        const SampleType* samples = ring.getFrame(group, index);
+                        for (int lane = 0; lane < ring.getGroupWidth(); ++lane)
+                            energy += samples[lane] * samples[lane];
+                    }
+                }
+                hopSum += float(energy);
+            }
+            hopFill += numToDo;
+            done += numToDo;
+
+            if (hopFill < hopSize) break;
+
+            const float hopEnergy = hopSum * scale;
+            if (holdoffRemaining > 0)
+                --holdoffRemaining;
+            else if (hopEnergy > onsetFloor && hopEnergy > onsetRatio * slowEnvelope)
+            {
+                onOnset(done - hopSize);
+                holdoffRemaining = holdoffHops;
+            }
+
+            slowEnvelope += slowCoefficient * (hopEnergy - slowEnvelope);
+            hopSum = 0.0f;
+            hopFill = 0;
+        }
+    }
+
+private:
+    float hopSum{ 0.0f };
+    int hopFill{ 0 };
+    float slowEnvelope{ 0.0f };
+    float slowCoefficient{ 0.0f };
+    int holdoffHops{ 0 };
+    int holdoffRemaining{ 0 };
+};
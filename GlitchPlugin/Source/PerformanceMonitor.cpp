@@ -0,0 +1,82 @@
+/*
+  ==============================================================================
+
+    PerformanceMonitor.cpp
+    Created: 17 Oct 2026 7:12:05pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#include "PerformanceMonitor.h"
+
+#if GLITCH_INSTRUMENTATION
+
+const char* PerformanceMonitor::getStageName(Stage stage)
+{
+    switch (stage)
+    {
+    case ringWrite: return "ring write";
+    case capture:   return "capture";
+    case resample:  return "resample";
+    case fade:      return "fade";
+    case grains:    return "grains";
+    case lfo:       return "lfo";
+    case total:     return "total";
+    default:        return "";
+    }
+}
+
+PerformanceMonitor::Snapshot PerformanceMonitor::poll()
+{
+    //moves the new blocks into the window, overwriting the oldest ones
+    const int numReady = fifo.getNumReady();
+    {
+        const auto scope = fifo.read(numReady);
+        auto take = [this](int start, int size)
+        {
+            for (int i = start; i < start + size; ++i)
+            {
+                window[size_t(windowWriteIndex)] = fifoBlocks[size_t(i)];
+                windowWriteIndex = (windowWriteIndex + 1) % windowSize;
+            }
+        };
+        take(scope.startIndex1, scope.blockSize1);
+        take(scope.startIndex2, scope.blockSize2);
+    }
+    windowFill = juce::jmin(windowSize, windowFill + numReady);
+
+    Snapshot snapshot;
+    snapshot.numBlocks = windowFill;
+    snapshot.numOverruns = numOverruns.load(std::memory_order_relaxed);
+    snapshot.numDropped = numDropped.load(std::memory_order_relaxed);
+    if (windowFill == 0) return snapshot;
+
+    const double microsecondsPerTick = 1.0e6 / double(juce::Time::getHighResolutionTicksPerSecond());
+    std::array<juce::int64, windowSize> sorted;
+
+    for (int stage = 0; stage < numStages; ++stage)
+    {
+        juce::int64 sum = 0;
+        for (int i = 0; i < windowFill; ++i)
+        {
+            sorted[size_t(i)] = window[size_t(i)].ticks[stage];
+            sum += sorted[size_t(i)];
+        }
+
+        //only the tail has to be in order for the 99th percentile
+        const auto end = sorted.begin() + windowFill;
+        const auto p99 = sorted.begin() + juce::jmin(windowFill - 1, (windowFill * 99) / 100);
+        std::nth_element(sorted.begin(), p99, end);
+
+        auto& stats = snapshot.stages[stage];
+        stats.min = double(*std::min_element(sorted.begin(), end)) * microsecondsPerTick;
+        stats.max = double(*std::max_element(sorted.begin(), end)) * microsecondsPerTick;
+        stats.mean = double(sum) / windowFill * microsecondsPerTick;
+        stats.p99 = double(*p99) * microsecondsPerTick;
+    }
+
+    return snapshot;
+}
+
+#endif
@@ -0,0 +1,134 @@
+/*
+  ==============================================================================
+
+    PerformanceMonitor.h
+    Created: 17 Oct 2026 7:12:05pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+//times the stages of every processed block, on by default in debug builds. with 0 the monitor and every measurement are left out
+#ifndef GLITCH_INSTRUMENTATION
+ #if JUCE_DEBUG
+  #define GLITCH_INSTRUMENTATION 1
+ #else
+  #define GLITCH_INSTRUMENTATION 0
+ #endif
+#endif
+
+#if GLITCH_INSTRUMENTATION
+
+//collects how long each stage of a block takes, in ticks of the high resolution counter.
+//the audio thread only adds up ticks and hands every finished block to a fifo, which is wait free.
+//the statistics are worked out from the fifo by whoever polls, which has to be a single thread
+class PerformanceMonitor
+{
+public:
+    enum Stage
+    {
+        ringWrite,
+        capture,
+        resample,
+        fade,
+        grains,
+        lfo,
+        total,
+        numStages
+    };
+
+    static const char* getStageName(Stage stage);
+
+    //adds the time between its construction and destruction to a stage, does nothing without a monitor
+    class ScopedStage
+    {
+    public:
+        ScopedStage(PerformanceMonitor* m, Stage s) : monitor(m), stage(s), start(m != nullptr ? juce::Time::getHighResolutionTicks() : 0) {}
+        ~ScopedStage()
+        {
+            if (monitor != nullptr)
+                monitor->current.ticks[stage] += juce::Time::getHighResolutionTicks() - start;
+        }
+
+    private:
+        PerformanceMonitor* monitor;
+        Stage stage;
+        juce::int64 start;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedStage)
+    };
+
+    //called by the audio thread around each block, a block that takes longer than it plays counts as an overrun
+    void beginBlock(int numSamples, double sampleRate)
+    {
+        current = {};
+        deadline = sampleRate > 0.0 ? juce::Time::secondsToHighResolutionTicks(numSamples / sampleRate) : 0;
+        blockStart = juce::Time::getHighResolutionTicks();
+    }
+
+    void endBlock()
+    {
+        current.ticks[total] = juce::Time::getHighResolutionTicks() - blockStart;
+        if (deadline > 0 && current.ticks[total] > deadline)
+            numOverruns.fetch_add(1, std::memory_order_relaxed);
+
+        //a block the poller has no room for yet is only counted
+        const auto scope = fifo.write(1);
+        if (scope.blockSize1 > 0)
+            fifoBlocks[size_t(scope.startIndex1)] = current;
+        else
+            numDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    struct StageStats
+    {
+        double min{ 0.0 };
+        double mean{ 0.0 };
+        double p99{ 0.0 };
+        double max{ 0.0 };
+    };
+
+    //statistics over the last windowSize blocks, in microseconds
+    struct Snapshot
+    {
+        StageStats stages[numStages];
+        int numBlocks{ 0 };
+        juce::int64 numOverruns{ 0 };
+        juce::int64 numDropped{ 0 };
+    };
+
+    static constexpr int windowSize = 1024;
+
+    //takes in the blocks finished since the last call, not to be called on the audio thread
+    Snapshot poll();
+
+private:
+    struct BlockTiming
+    {
+        juce::int64 ticks[numStages]{};
+    };
+
+    //written by the audio thread only
+    BlockTiming current;
+    juce::int64 blockStart{ 0 };
+    juce::int64 deadline{ 0 };
+
+    static constexpr int fifoSize = windowSize;
+    juce::AbstractFifo fifo{ fifoSize };
+    std::array<BlockTiming, fifoSize> fifoBlocks;
+    std::atomic<juce::int64> numOverruns{ 0 };
+    std::atomic<juce::int64> numDropped{ 0 };
+
+    //owned by the polling thread
+    std::array<BlockTiming, windowSize> window;
+    int windowFill{ 0 };
+    int windowWriteIndex{ 0 };
+};
+
+ #define GLITCH_MEASURE_STAGE(monitor, stage) const PerformanceMonitor::ScopedStage JUCE_JOIN_MACRO(stageMeasurement, __LINE__)(monitor, PerformanceMonitor::stage)
+#else
+ #define GLITCH_MEASURE_STAGE(monitor, stage)
+#endif
@@ -0,0 +1,53 @@
+/*
+  ==============================================================================
+
+    PerformanceOverlay.cpp
+    Created: 17 Oct 2026 7:40:51pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#include "PerformanceOverlay.h"
+
+#if GLITCH_INSTRUMENTATION
+
+PerformanceOverlay::PerformanceOverlay(PerformanceMonitor& m) : monitor(m)
+{
+    setInterceptsMouseClicks(false, false);
+    startTimerHz(4);
+}
+
+PerformanceOverlay::~PerformanceOverlay()
+{
+    stopTimer();
+}
+
+void PerformanceOverlay::paint(juce::Graphics& g)
+{
+    g.fillAll(juce::Colours::darkgrey.withAlpha(0.8f));
+    g.setColour(juce::Colours::white);
+    g.setFont(juce::FontOptions(juce::Font::getDefaultMonospacedFontName(), 11.0f, juce::Font::plain));
+
+    const int lineHeight = 13;
+    auto area = getLocalBounds().reduced(6, 4);
+    auto drawLine = [&](const juce::String& text) { g.drawText(text, area.removeFromTop(lineHeight), juce::Justification::left, false); };
+
+    drawLine(juce::String("stage        min     mean    p99     max   (us, last ") + juce::String(snapshot.numBlocks) + " blocks)");
+    for (int stage = 0; stage < PerformanceMonitor::numStages; ++stage)
+    {
+        const auto& stats = snapshot.stages[stage];
+        drawLine(juce::String(PerformanceMonitor::getStageName(PerformanceMonitor::Stage(stage))).paddedRight(' ', 10)
+                 + juce::String(stats.min, 1).paddedLeft(' ', 8) + juce::String(stats.mean, 1).paddedLeft(' ', 8)
+                 + juce::String(stats.p99, 1).paddedLeft(' ', 8) + juce::String(stats.max, 1).paddedLeft(' ', 8));
+    }
+    drawLine("overruns " + juce::String(snapshot.numOverruns) + ", dropped " + juce::String(snapshot.numDropped));
+}
+
+void PerformanceOverlay::timerCallback()
+{
+    snapshot = monitor.poll();
+    repaint();
+}
+
+#endif
@@ -0,0 +1,37 @@
+/*
+  ==============================================================================
+
+    PerformanceOverlay.h
+    Created: 17 Oct 2026 7:40:51pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include "PerformanceMonitor.h"
+
+#if GLITCH_INSTRUMENTATION
+
+//a table of the block timings of the processor, polled a few times per second
+class PerformanceOverlay : public juce::Component, private juce::Timer
+{
+public:
+    static constexpr int height = 130;
+
+    explicit PerformanceOverlay(PerformanceMonitor& monitor);
+    ~PerformanceOverlay() override;
+
+    void paint(juce::Graphics&) override;
+
+private:
+    void timerCallback() override;
+
+    PerformanceMonitor& monitor;
+    PerformanceMonitor::Snapshot snapshot;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PerformanceOverlay)
+};
+
+#endif
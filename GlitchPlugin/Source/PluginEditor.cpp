@@ -12,38 +12,70 @@
 //==============================================================================
 GlitchPluginAudioProcessorEditor::GlitchPluginAudioProcessorEditor (GlitchPluginAudioProcessor& p)
     : AudioProcessorEditor (&p), audioProcessor (p), lfo(p, p.getLFO())
+   #if GLITCH_INSTRUMENTATION
+    , performanceOverlay(p.getPerformanceMonitor())
+   #endif
 {
     lookAndFeel.setColour(juce::ResizableWindow::backgroundColourId, juce::Colours::black);
     lookAndFeel.setColour(juce::Slider::thumbColourId, juce::Colours::white);
     setLookAndFeel(&lookAndFeel);
 
 
-    toggleStutterButton.setToggleState(false, false);
-    toggleStutterButton.onClick = [&]()
+    auto& parameters = audioProcessor.getValueTreeState();
+
+    toggleStutterButton.setClickingTogglesState(true);
+    toggleStutterButton.onStateChange = [&]()
         {
-            toggleStutterButton.setToggleState(!toggleStutterButton.getToggleState(), false);
             toggleStutterButton.setButtonText(toggleStutterButton.getToggleState() ? "Stutter Off" : "Stutter On");
-            audioProcessor.setStutterState(toggleStutterButton.getToggleState());
         };
+    stutterAttachment = std::make_unique<ButtonAttachment>(parameters, ParameterIDs::stutter, toggleStutterButton);
+    toggleStutterButton.onStateChange();
     addAndMakeVisible(toggleStutterButton);
 
-    createStutterParameterSlider(stutterDurationSlider, 20.f, 1000.f, 500, 0.0, " ms", 1, stutterDurationLabel, "Size");
-    createStutterParameterSlider(repeatSlider, 1, 10, 3, 0.0, "", 0, repeatLabel, "Repeats");
-    createStutterParameterSlider(ratioSlider, -2.0, 2.0, 1.0, 0.1, "", 1, ratioLabel, "Ratio");
+    createChoiceBox(fadeShapeBox, fadeShapeAttachment, ParameterIDs::fadeShape);
+
+    highQualityAttachment = std::make_unique<ButtonAttachment>(parameters, ParameterIDs::highQuality, highQualityToggle);
+    addAndMakeVisible(highQualityToggle);
+
+    createChoiceBox(linkGroupBox, linkGroupAttachment, ParameterIDs::linkGroup);
+
+    createChoiceBox(sizeSyncBox, sizeSyncAttachment, ParameterIDs::sizeSync);
+    createChoiceBox(quantizeBox, quantizeAttachment, ParameterIDs::quantize);
+    createChoiceBox(retroBox, retroAttachment, ParameterIDs::retro);
+
+    snapToOnsetAttachment = std::make_unique<ButtonAttachment>(parameters, ParameterIDs::snapToOnset, snapToOnsetToggle);
+    addAndMakeVisible(snapToOnsetToggle);
 
-    createModSlider(stutterDurationModSlider);
-    createModSlider(repeatModSlider);
-    createModSlider(ratioModSlider);
+    createStutterParameterSlider(stutterDurationSlider, stutterDurationAttachment, ParameterIDs::duration, " ms", 1, stutterDurationLabel, "Size");
+    createStutterParameterSlider(repeatSlider, repeatAttachment, ParameterIDs::repeats, "", 0, repeatLabel, "Repeats");
+    createStutterParameterSlider(ratioSlider, ratioAttachment, ParameterIDs::ratio, "", 1, ratioLabel, "Ratio");
+
+    createModSlider(stutterDurationModSlider, stutterDurationModAttachment, ParameterIDs::durationModDepth);
+    createModSlider(repeatModSlider, repeatModAttachment, ParameterIDs::repeatModDepth);
+    createModSlider(ratioModSlider, ratioModAttachment, ParameterIDs::ratioModDepth);
+
+    granularAttachment = std::make_unique<ButtonAttachment>(parameters, ParameterIDs::granular, granularToggle);
+    addAndMakeVisible(granularToggle);
+    createChoiceBox(grainWindowBox, grainWindowAttachment, ParameterIDs::grainWindow);
+    createStutterParameterSlider(grainDensitySlider, grainDensityAttachment, ParameterIDs::grainDensity, " /s", 0, grainDensityLabel, "Density");
+    createStutterParameterSlider(grainSizeSlider, grainSizeAttachment, ParameterIDs::grainSize, " ms", 1, grainSizeLabel, "Grain");
+    createStutterParameterSlider(grainSpraySlider, grainSprayAttachment, ParameterIDs::grainSpray, " ms", 0, grainSprayLabel, "Spray");
+    createStutterParameterSlider(grainPitchSlider, grainPitchAttachment, ParameterIDs::grainPitch, " st", 1, grainPitchLabel, "Pitch");
 
     addAndMakeVisible(lfo);
-    setSize (600, 400);
+
+   #if GLITCH_INSTRUMENTATION
+    //the timings get a strip of their own below the controls
+    addAndMakeVisible(performanceOverlay);
+    setSize (600, 500 + PerformanceOverlay::height);
+   #else
+    setSize (600, 500);
+   #endif
+    startTimerHz(10);
 }
 
 GlitchPluginAudioProcessorEditor::~GlitchPluginAudioProcessorEditor()
 {
-    repeatSlider.removeListener(this);
-    stutterDurationSlider.removeListener(this);
-    ratioSlider.removeListener(this);
     setLookAndFeel(nullptr);
 }
 
@@ -60,72 +92,83 @@ void GlitchPluginAudioProcessorEditor::paint (juce::Graphics& g)
 void GlitchPluginAudioProcessorEditor::resized()
 {
     int effectAreaHeight = 200;
+    int grainAreaHeight = 100;
     int lfoAreaHeight = 200;
     toggleStutterButton.setBounds(50, effectAreaHeight * 0.25, 80, 50);
+    fadeShapeBox.setBounds(40, effectAreaHeight * 0.6, 100, 24);
+    highQualityToggle.setBounds(40, effectAreaHeight * 0.6 + 30, 100, 24);
+    linkGroupBox.setBounds(40, effectAreaHeight * 0.6 + 56, 100, 22);
+    quantizeBox.setBounds(40, effectAreaHeight * 0.1, 100, 22);
     
     float durationSliderX = (getWidth() / 4 * 2) - 120;
     stutterDurationSlider.setBounds(durationSliderX , effectAreaHeight * 0.2, 80, 80);
     stutterDurationModSlider.setBounds(durationSliderX + 16, effectAreaHeight * 0.8, 45, 45);
+    sizeSyncBox.setBounds(durationSliderX, effectAreaHeight * 0.6 + 8, 80, 22);
 
     float repeatSliderX = (getWidth() / 4 * 3) - 120;
     repeatSlider.setBounds(repeatSliderX, effectAreaHeight * 0.2, 80, 80);
     repeatModSlider.setBounds(repeatSliderX + 16, effectAreaHeight * 0.8, 45, 45);
+    retroBox.setBounds(repeatSliderX, effectAreaHeight * 0.6 + 8, 80, 22);
 
     float ratioSliderX = (getWidth() / 4 * 4) - 120;
     ratioSlider.setBounds(ratioSliderX, effectAreaHeight * 0.2, 80, 80);
     ratioModSlider.setBounds(ratioSliderX + 16, effectAreaHeight * 0.8, 45, 45);
-
-
-    lfo.setBounds(0, effectAreaHeight + 10, getWidth(), lfoAreaHeight - 10);
+    snapToOnsetToggle.setBounds(ratioSliderX, effectAreaHeight * 0.6 + 8, 80, 22);
+
+    //the grain controls get a row of their own under the stutter controls
+    granularToggle.setBounds(40, effectAreaHeight + 20, 100, 24);
+    grainWindowBox.setBounds(40, effectAreaHeight + 56, 100, 22);
+    juce::Slider* grainSliders[] = { &grainDensitySlider, &grainSizeSlider, &grainSpraySlider, &grainPitchSlider };
+    for (int i = 0; i < 4; ++i)
+        grainSliders[i]->setBounds(180 + i * 100, effectAreaHeight + 25, 70, 70);
+
+    lfo.setBounds(0, effectAreaHeight + grainAreaHeight + 10, getWidth(), lfoAreaHeight - 10);
+   #if GLITCH_INSTRUMENTATION
+    performanceOverlay.setBounds(0, effectAreaHeight + grainAreaHeight + lfoAreaHeight, getWidth(), PerformanceOverlay::height);
+   #endif
 }
 
-void GlitchPluginAudioProcessorEditor::sliderValueChanged(juce::Slider* slider)
+void GlitchPluginAudioProcessorEditor::timerCallback()
 {
-    if (slider == &stutterDurationSlider) {
-        audioProcessor.setStutterDuration(stutterDurationSlider.getValue());
-    }
-    else if (slider == &repeatSlider) {
-        audioProcessor.setStutterRepeats(int(repeatSlider.getValue()));
-    }
-    else if (slider == &ratioSlider) {
-        auto value = ratioSlider.getValue();
+    const bool halved = audioProcessor.isSizeHalved();
+    if (halved == sizeSyncBox.isColourSpecified(juce::ComboBox::outlineColourId)) return;
 
-        if (value != 0.0) {
-            auto ratio = 1 / value;
-            audioProcessor.setPlaybackRatio(ratio);
-        }
-    }
-    else if (slider == &stutterDurationModSlider) {
-        audioProcessor.durationModDepth = stutterDurationModSlider.getValue();
+    if (halved) {
+        sizeSyncBox.setColour(juce::ComboBox::outlineColourId, juce::Colours::orange);
+        sizeSyncBox.setTooltip("Halved to fit the history, it grows with the input up to the History length");
     }
-    else if (slider == &repeatModSlider) {
-        audioProcessor.repeatModDepth = repeatModSlider.getValue();
-    }
-    else if (slider == &ratioModSlider) {
-        audioProcessor.ratioModDepth = ratioModSlider.getValue();
+    else {
+        sizeSyncBox.removeColour(juce::ComboBox::outlineColourId);
+        sizeSyncBox.setTooltip({});
     }
 }
 
-void GlitchPluginAudioProcessorEditor::createModSlider(juce::Slider& slider)
+void GlitchPluginAudioProcessorEditor::createChoiceBox(juce::ComboBox& box, std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment>& attachment, const char* parameterID)
+{
+    //the items are the choices of the parameter, so the box lists them in the same order
+    auto& parameters = audioProcessor.getValueTreeState();
+    if (auto* choice = dynamic_cast<juce::AudioParameterChoice*>(parameters.getParameter(parameterID)))
+        box.addItemList(choice->choices, 1);
+    attachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(parameters, parameterID, box);
+    addAndMakeVisible(box);
+}
+
+void GlitchPluginAudioProcessorEditor::createModSlider(juce::Slider& slider, std::unique_ptr<SliderAttachment>& attachment, const char* parameterID)
 {
-    slider.setRange(0, 1);
-    slider.setValue(0.0);
     slider.setNumDecimalPlacesToDisplay(1);
     slider.setSliderStyle(juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag);
     slider.setTextBoxStyle(juce::Slider::TextEntryBoxPosition::NoTextBox, false, 60, 20);
-    slider.addListener(this);
+    attachment = std::make_unique<SliderAttachment>(audioProcessor.getValueTreeState(), parameterID, slider);
     addAndMakeVisible(slider);
 }
 
-void GlitchPluginAudioProcessorEditor::createStutterParameterSlider(juce::Slider& slider, float min, float max, float defaultVal, double interval, juce::String suffix, int decimals, juce::Label& label, juce::String labelText)
+void GlitchPluginAudioProcessorEditor::createStutterParameterSlider(juce::Slider& slider, std::unique_ptr<SliderAttachment>& attachment, const char* parameterID, juce::String suffix, int decimals, juce::Label& label, juce::String labelText)
 {
-    slider.setRange(min, max, interval);
-    slider.setValue(defaultVal);
     if(suffix.isNotEmpty()) slider.setTextValueSuffix(suffix);
     slider.setNumDecimalPlacesToDisplay(decimals);
-    slider.addListener(this);
     slider.setSliderStyle(juce::Slider::SliderStyle::RotaryHorizontalVerticalDrag);
     slider.setTextBoxStyle(juce::Slider::TextEntryBoxPosition::TextBoxBelow, false, 60, 20);
+    attachment = std::make_unique<SliderAttachment>(audioProcessor.getValueTreeState(), parameterID, slider);
     addAndMakeVisible(slider);
 
     label.setText(labelText, juce::dontSendNotification);
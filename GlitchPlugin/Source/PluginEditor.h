@@ -11,11 +11,13 @@
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
 #include "LFOVisualizer.h"
+#include "PerformanceOverlay.h"
 
 //==============================================================================
 /**
 */ 
-class GlitchPluginAudioProcessorEditor  : public juce::AudioProcessorEditor, public juce::Slider::Listener
+class GlitchPluginAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                          private juce::Timer
 {
 public:
     GlitchPluginAudioProcessorEditor (GlitchPluginAudioProcessor&);
@@ -25,12 +27,17 @@ public:
     void paint (juce::Graphics&) override;
     void resized() override;
 
-    void sliderValueChanged(juce::Slider* slider) override;
-
 private:
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     juce::TextButton toggleStutterButton{ "Stutter On" };
+    juce::ComboBox fadeShapeBox;
+    juce::ToggleButton highQualityToggle{ "HQ" };
+    juce::ComboBox linkGroupBox;
+    juce::ComboBox sizeSyncBox;
+    juce::ComboBox quantizeBox;
+    juce::ComboBox retroBox;
+    juce::ToggleButton snapToOnsetToggle{ "Snap" };
     juce::Slider stutterDurationSlider;
     juce::Slider repeatSlider;
     juce::Slider ratioSlider;
@@ -44,13 +51,56 @@ private:
     juce::Label repeatLabel;
     juce::Label ratioLabel;
 
+    juce::ToggleButton granularToggle{ "Granular" };
+    juce::ComboBox grainWindowBox;
+    juce::Slider grainDensitySlider;
+    juce::Slider grainSizeSlider;
+    juce::Slider grainSpraySlider;
+    juce::Slider grainPitchSlider;
+    juce::Label grainDensityLabel;
+    juce::Label grainSizeLabel;
+    juce::Label grainSprayLabel;
+    juce::Label grainPitchLabel;
+
     juce::LookAndFeel_V4 lookAndFeel;
+    juce::TooltipWindow tooltipWindow{ this };
 
     LFOVisualizer lfo;
+   #if GLITCH_INSTRUMENTATION
+    PerformanceOverlay performanceOverlay;
+   #endif
     GlitchPluginAudioProcessor& audioProcessor;
 
-    void createModSlider(juce::Slider& slider);
-    void createStutterParameterSlider(juce::Slider& slider, float min, float max, float defaultVal, double interval, juce::String suffix, int decimals, juce::Label& label, juce::String labelText);
+    //declared after the controls, so they are detached before the controls go away
+    using SliderAttachment = juce::AudioProcessorValueTreeState::SliderAttachment;
+    using ButtonAttachment = juce::AudioProcessorValueTreeState::ButtonAttachment;
+    std::unique_ptr<ButtonAttachment> stutterAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> fadeShapeAttachment;
+    std::unique_ptr<ButtonAttachment> highQualityAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> linkGroupAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> sizeSyncAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> quantizeAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> retroAttachment;
+    std::unique_ptr<ButtonAttachment> snapToOnsetAttachment;
+    std::unique_ptr<SliderAttachment> stutterDurationAttachment;
+    std::unique_ptr<SliderAttachment> repeatAttachment;
+    std::unique_ptr<SliderAttachment> ratioAttachment;
+    std::unique_ptr<SliderAttachment> stutterDurationModAttachment;
+    std::unique_ptr<SliderAttachment> repeatModAttachment;
+    std::unique_ptr<SliderAttachment> ratioModAttachment;
+    std::unique_ptr<ButtonAttachment> granularAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> grainWindowAttachment;
+    std::unique_ptr<SliderAttachment> grainDensityAttachment;
+    std::unique_ptr<SliderAttachment> grainSizeAttachment;
+    std::unique_ptr<SliderAttachment> grainSprayAttachment;
+    std::unique_ptr<SliderAttachment> grainPitchAttachment;
+
+    //marks the size sync box while the synced size is halved to fit the history
+    void timerCallback() override;
+
+    void createChoiceBox(juce::ComboBox& box, std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment>& attachment, const char* parameterID);
+    void createModSlider(juce::Slider& slider, std::unique_ptr<SliderAttachment>& attachment, const char* parameterID);
+    void createStutterParameterSlider(juce::Slider& slider, std::unique_ptr<SliderAttachment>& attachment, const char* parameterID, juce::String suffix, int decimals, juce::Label& label, juce::String labelText);
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GlitchPluginAudioProcessorEditor)
 };
@@ -10,6 +10,46 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+namespace
+{
+    //a note length in quarter notes, or in bars of the current time signature
+    struct NoteDivision
+    {
+        const char* name;
+        double length;
+        bool inBars;
+    };
+
+    //the first entry of both leaves the size free and the triggers unquantized
+    const NoteDivision sizeDivisions[] = {
+        { "Free", 0.0, false },
+        { "1/64", 1.0 / 16.0, false }, { "1/32", 1.0 / 8.0, false }, { "1/16T", 1.0 / 6.0, false }, { "1/16", 1.0 / 4.0, false },
+        { "1/8T", 1.0 / 3.0, false }, { "1/16.", 3.0 / 8.0, false }, { "1/8", 1.0 / 2.0, false }, { "1/4T", 2.0 / 3.0, false },
+        { "1/8.", 3.0 / 4.0, false }, { "1/4", 1.0, false }, { "1/2T", 4.0 / 3.0, false }, { "1/4.", 3.0 / 2.0, false },
+        { "1/2", 2.0, false }, { "1/2.", 3.0, false }, { "1 bar", 1.0, true }, { "2 bars", 2.0, true }
+    };
+
+    const NoteDivision quantizeDivisions[] = {
+        { "Off", 0.0, false },
+        { "1/16", 1.0 / 4.0, false }, { "1/8", 1.0 / 2.0, false }, { "1/4", 1.0, false }, { "1/2", 2.0, false }, { "1 bar", 1.0, true }
+    };
+
+    template <size_t numDivisions>
+    juce::StringArray getDivisionNames(const NoteDivision (&divisions)[numDivisions])
+    {
+        juce::StringArray names;
+        for (const auto& division : divisions)
+            names.add(division.name);
+        return names;
+    }
+
+    template <size_t numDivisions>
+    const NoteDivision& getDivision(const NoteDivision (&divisions)[numDivisions], float parameterValue)
+    {
+        return divisions[juce::jlimit(0, int(numDivisions) - 1, int(parameterValue))];
+    }
+}
+
 //==============================================================================
 GlitchPluginAudioProcessor::GlitchPluginAudioProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -23,10 +63,137 @@ GlitchPluginAudioProcessor::GlitchPluginAudioProcessor()
                        )
 #endif
 {
+    stutterParam = parameters.getRawParameterValue(ParameterIDs::stutter);
+    durationParam = parameters.getRawParameterValue(ParameterIDs::duration);
+    repeatsParam = parameters.getRawParameterValue(ParameterIDs::repeats);
+    ratioParam = parameters.getRawParameterValue(ParameterIDs::ratio);
+    fadeShapeParam = parameters.getRawParameterValue(ParameterIDs::fadeShape);
+    highQualityParam = parameters.getRawParameterValue(ParameterIDs::highQuality);
+    durationModDepthParam = parameters.getRawParameterValue(ParameterIDs::durationModDepth);
+    repeatModDepthParam = parameters.getRawParameterValue(ParameterIDs::repeatModDepth);
+    ratioModDepthParam = parameters.getRawParameterValue(ParameterIDs::ratioModDepth);
+    lfoEnabledParam = parameters.getRawParameterValue(ParameterIDs::lfoEnabled);
+    lfoFreqParam = parameters.getRawParameterValue(ParameterIDs::lfoFreq);
+    lfoSyncParam = parameters.getRawParameterValue(ParameterIDs::lfoSync);
+    lfoSyncRateParam = parameters.getRawParameterValue(ParameterIDs::lfoSyncRate);
+    linkGroupParam = parameters.getRawParameterValue(ParameterIDs::linkGroup);
+    historyLengthParam = parameters.getRawParameterValue(ParameterIDs::historyLength);
+    sizeSyncParam = parameters.getRawParameterValue(ParameterIDs::sizeSync);
+    quantizeParam = parameters.getRawParameterValue(ParameterIDs::quantize);
+    retroParam = parameters.getRawParameterValue(ParameterIDs::retro);
+    snapToOnsetParam = parameters.getRawParameterValue(ParameterIDs::snapToOnset);
+    granularParam = parameters.getRawParameterValue(ParameterIDs::granular);
+    grainDensityParam = parameters.getRawParameterValue(ParameterIDs::grainDensity);
+    grainSizeParam = parameters.getRawParameterValue(ParameterIDs::grainSize);
+    grainSprayParam = parameters.getRawParameterValue(ParameterIDs::grainSpray);
+    grainPitchParam = parameters.getRawParameterValue(ParameterIDs::grainPitch);
+    grainWindowParam = parameters.getRawParameterValue(ParameterIDs::grainWindow);
+
+   #if GLITCH_INSTRUMENTATION
+    floatStutterBuffer.setPerformanceMonitor(&performanceMonitor);
+    doubleStutterBuffer.setPerformanceMonitor(&performanceMonitor);
+   #endif
+
+    parameters.addParameterListener(ParameterIDs::linkGroup, this);
+    parameters.addParameterListener(ParameterIDs::historyLength, this);
 }
 
 GlitchPluginAudioProcessor::~GlitchPluginAudioProcessor()
 {
+    parameters.removeParameterListener(ParameterIDs::linkGroup, this);
+    parameters.removeParameterListener(ParameterIDs::historyLength, this);
+    cancelPendingUpdate();
+}
+
+juce::AudioProcessorValueTreeState::ParameterLayout GlitchPluginAudioProcessor::createParameterLayout()
+{
+    using Attributes = juce::AudioParameterFloatAttributes;
+    auto withDecimals = [](int decimals)
+    {
+        return Attributes().withStringFromValueFunction([decimals](float value, int) { return juce::String(value, decimals); });
+    };
+
+    //loops up to a second are the usual range, so it takes the first half of the control
+    auto durationRange = []
+    {
+        juce::NormalisableRange<float> range(20.f, 15000.f);
+        range.setSkewForCentre(1000.f);
+        return range;
+    };
+
+    juce::AudioProcessorValueTreeState::ParameterLayout layout;
+
+    layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID{ ParameterIDs::stutter, 1 }, "Stutter", false));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ ParameterIDs::duration, 1 }, "Size",
+                                                           durationRange(), 500.f, withDecimals(1).withLabel("ms")));
+    //a synced size follows the tempo of the host and replaces the size in ms
+    layout.add(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID{ ParameterIDs::sizeSync, 1 }, "Size Sync",
+                                                            getDivisionNames(sizeDivisions), 0));
+    //holds back a trigger until the next line of the grid, counted from the start of the bar
+    layout.add(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID{ ParameterIDs::quantize, 1 }, "Quantize",
+                                                            getDivisionNames(quantizeDivisions), 0));
+    //a retro loop starts on the beat that many beats before the trigger instead of ending at it
+    layout.add(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID{ ParameterIDs::retro, 1 }, "Retro",
+                                                            juce::StringArray{ "Off", "1 beat", "2 beats", "4 beats", "8 beats" }, 0));
+    layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID{ ParameterIDs::snapToOnset, 1 }, "Snap", false));
+    layout.add(std::make_unique<juce::AudioParameterInt>(juce::ParameterID{ ParameterIDs::repeats, 1 }, "Repeats", 1, 10, 3));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ ParameterIDs::ratio, 1 }, "Ratio",
+                                                           juce::NormalisableRange<float>(-2.f, 2.f, 0.1f), 1.f, withDecimals(1)));
+    layout.add(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID{ ParameterIDs::fadeShape, 1 }, "Fade Shape",
+                                                            juce::StringArray{ "Linear", "Equal Power", "Raised Cosine" }, 0));
+    layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID{ ParameterIDs::highQuality, 1 }, "HQ", false));
+
+    //the stutter plays grains of the newest input instead of a loop, the ratio sets their speed
+    auto grainRange = [](float start, float end, float centre)
+    {
+        juce::NormalisableRange<float> range(start, end);
+        range.setSkewForCentre(centre);
+        return range;
+    };
+    layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID{ ParameterIDs::granular, 1 }, "Granular", false));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ ParameterIDs::grainDensity, 1 }, "Density",
+                                                           grainRange(5.f, 500.f, 100.f), 100.f, withDecimals(0).withLabel("/s")));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ ParameterIDs::grainSize, 1 }, "Grain",
+                                                           grainRange(5.f, 250.f, 50.f), 50.f, withDecimals(1).withLabel("ms")));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ ParameterIDs::grainSpray, 1 }, "Spray",
+                                                           grainRange(0.f, 1000.f, 200.f), 100.f, withDecimals(0).withLabel("ms")));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ ParameterIDs::grainPitch, 1 }, "Pitch Spread",
+                                                           juce::NormalisableRange<float>(0.f, 12.f), 0.f, withDecimals(1).withLabel("st")));
+    layout.add(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID{ ParameterIDs::grainWindow, 1 }, "Grain Window",
+                                                            juce::StringArray{ "Hann", "Tukey", "Expodec", "Random" }, 0));
+
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ ParameterIDs::durationModDepth, 1 }, "Size Mod",
+                                                           juce::NormalisableRange<float>(0.f, 1.f), 0.f, withDecimals(1)));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ ParameterIDs::repeatModDepth, 1 }, "Repeats Mod",
+                                                           juce::NormalisableRange<float>(0.f, 1.f), 0.f, withDecimals(1)));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ ParameterIDs::ratioModDepth, 1 }, "Ratio Mod",
+                                                           juce::NormalisableRange<float>(0.f, 1.f), 0.f, withDecimals(1)));
+
+    layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID{ ParameterIDs::lfoEnabled, 1 }, "LFO On/Off", false));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ ParameterIDs::lfoFreq, 1 }, "Freq",
+                                                           juce::NormalisableRange<float>(0.1f, 1.f), 0.5f, withDecimals(1).withLabel("Hz")));
+    layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID{ ParameterIDs::lfoSync, 1 }, "Sync to beat", false));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ ParameterIDs::lfoSyncRate, 1 }, "Sync Rate",
+                                                           juce::NormalisableRange<float>(-2.f, 4.f, 1.f), 1.f,
+                                                           Attributes().withStringFromValueFunction([](float value, int)
+                                                           {
+                                                               double valueInBeats = pow(2, round(value));
+
+                                                               if (value >= 2) {
+                                                                   return juce::String(valueInBeats / 4) + " bars";
+                                                               }
+                                                               return "1 / " + juce::String(4 / valueInBeats);
+                                                           })));
+
+    //instances in the same group share the input history of their stutter, which only works if they see the same input
+    layout.add(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID{ ParameterIDs::linkGroup, 1 }, "Link",
+                                                            juce::StringArray{ "No Link", "Link 1", "Link 2", "Link 3", "Link 4", "Link 5", "Link 6", "Link 7", "Link 8" }, 0,
+                                                            juce::AudioParameterChoiceAttributes().withAutomatable(false)));
+    //how far back the stutter can reach, the memory for it is only allocated as the input comes in
+    layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID{ ParameterIDs::historyLength, 1 }, "History",
+                                                           juce::NormalisableRange<float>(4.f, 30.f, 1.f), 4.f,
+                                                           withDecimals(0).withLabel("s").withAutomatable(false)));
+    return layout;
 }
 
 //==============================================================================
@@ -95,8 +262,33 @@ void GlitchPluginAudioProcessor::changeProgramName (int index, const juce::Strin
 void GlitchPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
     sr = sampleRate;
-    stutterBuffer.prepareToPlay(getTotalNumInputChannels(), sr, static_cast<int>((stutterDuration.load() / 1000.f) * sr));
+    if (isUsingDoublePrecision())
+        stutterBuffer = &doubleStutterBuffer;
+    else
+        stutterBuffer = &floatStutterBuffer;
+
+    stutterBuffer->setSampleRate(sampleRate);
+
+    //reserving for the highest supported rate, so a later change of the sample rate does not allocate again
+    stutterBuffer->setLinkGroup(int(linkGroupParam->load()));
+    stutterBuffer->setMaximumBlockSize(juce::jmax(1, samplesPerBlock));
+    stutterBuffer->reserve(getTotalNumInputChannels(), int(juce::jmax(sampleRate, maxSupportedSampleRate)));
+    stutterBuffer->prepareToPlay(getTotalNumInputChannels(), sr, static_cast<int>((stutterDuration.load() / 1000.f) * sr));
+    stutterBuffer->setHistoryLength(int(historyLengthParam->load() * sampleRate));
     lfo.setSampleRate(sampleRate);
+
+    //sized once here, a longer block from the host is processed in parts of this size
+    maxBlockSize = juce::jmax(1, samplesPerBlock);
+    const int numChannels = juce::jmax(getTotalNumInputChannels(), getTotalNumOutputChannels());
+    modulationBuffer.setSize(numModulationChannels, maxBlockSize, false, false, true);
+    if (isUsingDoublePrecision())
+        dryDoubleBuffer.setSize(numChannels, maxBlockSize, false, false, true);
+    else
+        dryFloatBuffer.setSize(numChannels, maxBlockSize, false, false, true);
+    //prepareToPlay resets the stutter, and the other buffer has not seen any commands, so everything is posted again
+    postedStutterState = false;
+    postedDuration = -1;
+    postedRatio = 0.0;
 }
 
 void GlitchPluginAudioProcessor::releaseResources()
@@ -113,12 +305,9 @@ bool GlitchPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layo
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Any layout works, from mono up to the surround and ambisonic beds the stutter buffer has room for.
+    const int numChannels = layouts.getMainOutputChannelSet().size();
+    if (numChannels < 1 || numChannels > StutterBufferBase::maxNumChannels)
         return false;
 
     // This checks if the input layout matches the output layout
@@ -134,23 +323,283 @@ bool GlitchPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layo
 
 void GlitchPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    lfo.updateLFOState(buffer.getNumSamples());
+    jassert(stutterBuffer == &floatStutterBuffer);
+    processSamples(buffer, midiMessages, floatStutterBuffer, dryFloatBuffer, false);
+}
+
+void GlitchPluginAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    jassert(stutterBuffer == &doubleStutterBuffer);
+    processSamples(buffer, midiMessages, doubleStutterBuffer, dryDoubleBuffer, false);
+}
+
+void GlitchPluginAudioProcessor::processBlockBypassed (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    jassert(stutterBuffer == &floatStutterBuffer);
+    processSamples(buffer, midiMessages, floatStutterBuffer, dryFloatBuffer, true);
+}
+
+void GlitchPluginAudioProcessor::processBlockBypassed (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    jassert(stutterBuffer == &doubleStutterBuffer);
+    processSamples(buffer, midiMessages, doubleStutterBuffer, dryDoubleBuffer, true);
+}
+
+template <typename SampleType>
+void GlitchPluginAudioProcessor::processSamples(juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages, StutterBuffer<SampleType>& stutter,
+                                                juce::AudioBuffer<SampleType>& dryBuffer, bool bypassed)
+{
+    const int numSamples = buffer.getNumSamples();
+   #if GLITCH_INSTRUMENTATION
+    performanceMonitor.beginBlock(numSamples, getSampleRate());
+   #endif
 
     juce::AudioPlayHead* playhead = getPlayHead();
+    ppqPosition = {};
     if (playhead) {
-        isPlaying = playhead->getPosition()->getIsPlaying();
+        auto position = playhead->getPosition();
+        if (position.hasValue()) {
+            isPlaying = position->getIsPlaying();
+            hostBpm = position->getBpm().orFallback(hostBpm);
+            samplePosition = position->getTimeInSamples().orFallback(samplePosition);
+            ppqPosition = position->getPpqPosition();
+            ppqOfLastBarStart = position->getPpqPositionOfLastBarStart().orFallback(0.0);
+            if (auto timeSignature = position->getTimeSignature())
+                beatsPerBar = 4.0 * timeSignature->numerator / juce::jmax(1, timeSignature->denominator);
+        }
+    }
+
+    updateParameters();
+    if (lfo.isEnabled && isPlaying) {
+        GLITCH_MEASURE_STAGE(&performanceMonitor, lfo);
+        updatePositionInfoForLFO(playhead);
+    }
+
+    //a block longer than prepareToPlay announced goes through in parts, so none of the buffers has to grow on the audio thread.
+    //the parts refer to the samples of the block and move the timeline on as if the host had sent them one by one
+    for (int start = 0; start < numSamples; start += maxBlockSize) {
+        const int numToDo = juce::jmin(maxBlockSize, numSamples - start);
+        juce::AudioBuffer<SampleType> part(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start, numToDo);
+        const int midiEnd = start + numToDo < numSamples ? start + numToDo : std::numeric_limits<int>::max();
+        processPart(part, midiMessages, start, midiEnd, stutter, dryBuffer, bypassed);
+
+        samplePosition += numToDo;
+        if (ppqPosition.hasValue())
+            ppqPosition = *ppqPosition + numToDo * juce::jmax(hostBpm, 1.0) / (60.0 * sr);
+    }
+
+   #if GLITCH_INSTRUMENTATION
+    performanceMonitor.endBlock();
+   #endif
+}
+
+template <typename SampleType>
+void GlitchPluginAudioProcessor::processPart(juce::AudioBuffer<SampleType>& buffer, const juce::MidiBuffer& midiMessages, int midiStart, int midiEnd,
+                                             StutterBuffer<SampleType>& stutter, juce::AudioBuffer<SampleType>& dryBuffer, bool bypassed)
+{
+    const int numSamples = buffer.getNumSamples();
+
+    //the dry signal is only kept while the bypass fades, once it is through the stutter is turned off
+    //and keeps nothing but its history going, so the output is the input again
+    const float wetTarget = bypassed ? 0.f : 1.f;
+    const bool fading = wetGain != wetTarget;
+    if (fading) {
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            dryBuffer.copyFrom(channel, 0, buffer, channel, 0, numSamples);
+    }
+
+    //the lfo values are only read when it modulates, so a disabled lfo is not rendered at all
+    if (lfo.isEnabled) {
+        GLITCH_MEASURE_STAGE(&performanceMonitor, lfo);
+        lfo.renderBlock(modulationBuffer.getWritePointer(lfoChannel), numSamples);
     }
 
     if (isPlaying) {
-        if (lfo.isEnabled) {
-            updatePositionInfoForLFO(playhead);
-            lfo.updateLFOState(buffer.getNumSamples());
-            modulateStutterParameters();
+        const bool fullyBypassed = bypassed && !fading;
+        postStutterCommands(numSamples, fullyBypassed);
+        if (!fullyBypassed) handleMidi(midiMessages, midiStart, midiEnd, numSamples);
+        postBlockCommands();
+        if (lfo.isEnabled && !fullyBypassed) {
+            GLITCH_MEASURE_STAGE(&performanceMonitor, lfo);
+            modulateStutterParameters(numSamples);
+        }
+        stutter.setBlockPosition(samplePosition);
+        stutter.process(buffer);
+    }
+
+    if (fading) {
+        const float startGain = wetGain;
+        const float step = float(numSamples / juce::jmax(1.0, bypassFadeSeconds * getSampleRate()));
+        wetGain = bypassed ? juce::jmax(0.f, wetGain - step) : juce::jmin(1.f, wetGain + step);
+
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
+            buffer.applyGainRamp(channel, 0, numSamples, SampleType(startGain), SampleType(wetGain));
+            buffer.addFromWithRamp(channel, 0, dryBuffer.getReadPointer(channel), numSamples, SampleType(1.f - startGain), SampleType(1.f - wetGain));
         }
-        stutterBuffer.process(buffer);
     }
 }
 
+void GlitchPluginAudioProcessor::postStutterCommands(int numSamples, bool forceOff)
+{
+    //a bypassed plugin lets go of the stutter, the parameter and the next note take it up again afterwards
+    StutterCommand releaseNotes{ StutterCommand::Release, 0 };
+    releaseNotes.voice = -1;
+    if (forceOff) pendingNotes.reset();
+    if (forceOff && heldNotes.any() && stutterBuffer->postCommand(releaseNotes)) {
+        heldNotes.reset();
+        releasingNotes.reset();
+    }
+
+    //changes reach the stutter buffer as commands at the start of the block, a command that does not fit is posted again next block.
+    //they go before everything at a later offset, the stutter buffer does not go back to an earlier one
+    for (int note = 0; note < 128; ++note) {
+        if (!releasingNotes[size_t(note)]) continue;
+
+        //a release that did not fit into the queue, the note counts as held until it is through
+        StutterCommand command{ StutterCommand::Release, 0 };
+        command.voice = note + 1;
+        if (stutterBuffer->postCommand(command)) {
+            heldNotes.reset(size_t(note));
+            releasingNotes.reset(size_t(note));
+        }
+    }
+
+    int durationInSamples = getDurationInSamples();
+    if (durationInSamples != postedDuration
+        && stutterBuffer->postCommand({ StutterCommand::SetDuration, 0, float(durationInSamples) })) {
+        postedDuration = durationInSamples;
+    }
+
+    double ratio = stutterBuffer->getOrigRatio();
+    if (ratio != postedRatio
+        && stutterBuffer->postCommand({ StutterCommand::SetRatio, 0, float(ratio) })) {
+        postedRatio = ratio;
+    }
+
+    //a quantized trigger lands on its grid line instead, and waits for the block that contains it
+    bool stutterOn = stutterParam->load() > 0.5f && !forceOff;
+    if (stutterOn != postedStutterState) {
+        int offset = stutterOn ? getQuantizedTriggerOffset(0, numSamples) : 0;
+        if (offset >= 0)
+            addBlockCommand({ stutterOn ? StutterCommand::Trigger : StutterCommand::Release, offset, float(getRetroLookback(offset)) }, -1);
+    }
+}
+
+void GlitchPluginAudioProcessor::handleMidi(const juce::MidiBuffer& midiMessages, int midiStart, int midiEnd, int numSamples)
+{
+    //notes that came in before a grid line in a later block, until their line is in this one
+    const int pendingOffset = pendingNotes.any() ? getQuantizedTriggerOffset(0, numSamples) : -1;
+    for (int note = 0; note < 128 && pendingOffset >= 0; ++note) {
+        if (!pendingNotes[size_t(note)]) continue;
+
+        addBlockCommand(createNoteTrigger(note, pendingVelocities[size_t(note)], pendingOffset), note);
+        pendingNotes.reset(size_t(note));
+    }
+
+    //notes become commands at their sample position, or at the next grid line while triggers are quantized,
+    //so the stutter buffer splits the block right there
+    for (auto it = midiMessages.findNextSamplePosition(midiStart); it != midiMessages.cend(); ++it)
+    {
+        const auto metadata = *it;
+        if (metadata.samplePosition >= midiEnd) break;
+
+        const auto message = metadata.getMessage();
+        const int note = message.getNoteNumber();
+        const int offset = metadata.samplePosition - midiStart;
+
+        if (message.isNoteOn())
+        {
+            pendingNotes.reset(size_t(note));
+            const int triggerOffset = getQuantizedTriggerOffset(offset, numSamples);
+            if (triggerOffset >= 0) {
+                addBlockCommand(createNoteTrigger(note, message.getFloatVelocity(), triggerOffset), note);
+            }
+            else {
+                pendingNotes.set(size_t(note));
+                pendingVelocities[size_t(note)] = message.getFloatVelocity();
+            }
+        }
+        else if (message.isNoteOff())
+        {
+            //a note let go before its grid line never plays
+            if (pendingNotes[size_t(note)]) {
+                pendingNotes.reset(size_t(note));
+                continue;
+            }
+
+            //and neither does one let go before a grid line later in this block
+            int trigger = numBlockCommands;
+            while (--trigger >= 0 && !(blockCommands[size_t(trigger)].note == note && blockCommands[size_t(trigger)].command.type == StutterCommand::Trigger)) {}
+            if (trigger >= 0 && blockCommands[size_t(trigger)].command.sampleOffset > offset) {
+                std::move(blockCommands.begin() + trigger + 1, blockCommands.begin() + numBlockCommands, blockCommands.begin() + trigger);
+                --numBlockCommands;
+                trigger = -1;
+            }
+
+            if (trigger >= 0 || heldNotes[size_t(note)]) {
+                StutterCommand command{ StutterCommand::Release, offset };
+                command.voice = note + 1;
+                addBlockCommand(command, note);
+            }
+        }
+    }
+}
+
+StutterCommand GlitchPluginAudioProcessor::createNoteTrigger(int note, float velocity, int offset) const
+{
+    //the note picks the loop length, from one bar at midiBaseNote down to 1/64 six notes above, halved while the history is shorter
+    int division = juce::jlimit(0, 6, note - midiBaseNote);
+    float lengthInMs = float(4 * 60000.0 / juce::jmax(hostBpm, 1.0)) / float(1 << division);
+    int durationInSamples = fitToHistory(juce::jlimit(20.f, 15000.f, lengthInMs));
+
+    //every note plays a voice of its own next to the main stutter, a repeated note captures its loop again.
+    //velocity 64 plays at the original speed, soft notes play twice as fast and hard notes half as fast
+    StutterCommand command{ StutterCommand::Trigger, offset, float(getRetroLookback(offset)) };
+    command.voice = note + 1;
+    command.duration = float(durationInSamples);
+    command.ratio = 0.5f * std::pow(2.f, 2.f * velocity);
+    return command;
+}
+
+void GlitchPluginAudioProcessor::addBlockCommand(const StutterCommand& command, int note)
+{
+    if (numBlockCommands < int(blockCommands.size()))
+        blockCommands[size_t(numBlockCommands++)] = { command, note };
+}
+
+void GlitchPluginAudioProcessor::postBlockCommands()
+{
+    //sorted by offset, commands at the same offset keep the order they came in
+    for (int i = 1; i < numBlockCommands; ++i)
+        for (int j = i; j > 0 && blockCommands[size_t(j - 1)].command.sampleOffset > blockCommands[size_t(j)].command.sampleOffset; --j)
+            std::swap(blockCommands[size_t(j - 1)], blockCommands[size_t(j)]);
+
+    //the state only changes for what made it into the queue. the stutter parameter is posted again next block,
+    //a release is kept in releasingNotes, a note trigger that did not fit is dropped
+    for (int i = 0; i < numBlockCommands; ++i) {
+        const auto& blockCommand = blockCommands[size_t(i)];
+        const bool isTrigger = blockCommand.command.type == StutterCommand::Trigger;
+        const bool posted = stutterBuffer->postCommand(blockCommand.command);
+
+        if (blockCommand.note < 0) {
+            if (posted) postedStutterState = isTrigger;
+        }
+        else if (isTrigger) {
+            if (posted) {
+                heldNotes.set(size_t(blockCommand.note));
+                releasingNotes.reset(size_t(blockCommand.note));
+            }
+        }
+        else if (posted) {
+            heldNotes.reset(size_t(blockCommand.note));
+        }
+        else {
+            releasingNotes.set(size_t(blockCommand.note));
+        }
+    }
+    numBlockCommands = 0;
+}
+
 //==============================================================================
 bool GlitchPluginAudioProcessor::hasEditor() const
 {
@@ -165,72 +614,169 @@ juce::AudioProcessorEditor* GlitchPluginAudioProcessor::createEditor()
 //==============================================================================
 void GlitchPluginAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    if (auto xml = parameters.copyState().createXml())
+        copyXmlToBinary(*xml, destData);
 }
 
 void GlitchPluginAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    if (auto xml = getXmlFromBinary(data, sizeInBytes))
+        if (xml->hasTagName(parameters.state.getType()))
+            parameters.replaceState(juce::ValueTree::fromXml(*xml));
 }
 
-void GlitchPluginAudioProcessor::setStutterState(bool state)
+void GlitchPluginAudioProcessor::updateParameters()
 {
-    stutterBuffer.setStutterState(state);
+    //the lfo modulates around the values set here, so they are also its original values
+    stutterBuffer->setOrigDuration(getDurationInSamples());
+
+    int repeats = int(repeatsParam->load());
+    stutterBuffer->setOrigRepeats(repeats);
+    stutterBuffer->setStutterRepeats(repeats);
+
+    //a ratio slider value of 0 has no playback speed, the last valid ratio is kept
+    float ratioValue = ratioParam->load();
+    if (std::abs(ratioValue) >= 0.05f) {
+        stutterBuffer->setOrigRatio(1 / ratioValue);
+    }
+
+    stutterBuffer->setFadeShape(static_cast<StutterBufferBase::FadeShape>(juce::jlimit(0, StutterBufferBase::numFadeShapes - 1, int(fadeShapeParam->load()))));
+    stutterBuffer->setHighQuality(highQualityParam->load() > 0.5f);
+    stutterBuffer->setSnapToOnset(snapToOnsetParam->load() > 0.5f);
+
+    stutterBuffer->setGranular(granularParam->load() > 0.5f);
+    stutterBuffer->setGrainDensity(grainDensityParam->load());
+    stutterBuffer->setGrainLength(float(convertMsToSamples(grainSizeParam->load())));
+    stutterBuffer->setGrainSpray(float(convertMsToSamples(grainSprayParam->load())));
+    stutterBuffer->setGrainPitchSpread(grainPitchParam->load());
+    stutterBuffer->setGrainWindow(juce::jlimit(0, int(GrainWindows::numShapes), int(grainWindowParam->load())));
+
+    lfo.enableLFO(lfoEnabledParam->load() > 0.5f);
+    lfo.setFreq(lfoFreqParam->load());
+    lfo.enableSync(lfoSyncParam->load() > 0.5f);
+    lfo.setSyncFactor(1 / (pow(2, round(lfoSyncRateParam->load()))));
 }
 
-void GlitchPluginAudioProcessor::setStutterDuration(float durationInMs)
+int GlitchPluginAudioProcessor::convertMsToSamples(float ms)
 {
-    if (lfo.isEnabled) stutterBuffer.setOrigDuration(convertMsToSamples(durationInMs));
-
-    int numSamples = convertMsToSamples(durationInMs);
-    stutterBuffer.setStutterDurationInSamples(numSamples);
+    return (ms / 1000.f) * sr;
 }
 
-void GlitchPluginAudioProcessor::setStutterRepeats(int repeats)
-{  
-    if (lfo.isEnabled) stutterBuffer.setOrigRepeats(repeats);
-    stutterBuffer.setStutterRepeats(repeats);
+int GlitchPluginAudioProcessor::getDurationInSamples()
+{
+    const auto& division = getDivision(sizeDivisions, sizeSyncParam->load());
+    if (division.length <= 0.0) {
+        sizeHalved.store(false);
+        return convertMsToSamples(durationParam->load());
+    }
+
+    //kept within the range of the size parameter, and halved while the history is too short for it
+    const double beats = division.inBars ? division.length * beatsPerBar : division.length;
+    const float lengthInMs = float(beats * 60000.0 / juce::jmax(hostBpm, 1.0));
+    bool halved = false;
+    const int length = fitToHistory(juce::jlimit(20.f, 15000.f, lengthInMs), &halved);
+    sizeHalved.store(halved);
+    return length;
 }
 
-void GlitchPluginAudioProcessor::setPlaybackRatio(double ratio)
+int GlitchPluginAudioProcessor::fitToHistory(float lengthInMs, bool* halved) const
 {
-    if (lfo.isEnabled) stutterBuffer.setOrigRatio(ratio);
-    stutterBuffer.setRatio(ratio);
+    //halving keeps the loop on the grid, where cutting it to the history would leave it out of phase
+    const int maxLength = stutterBuffer->getMaxLoopLength();
+    double length = lengthInMs / 1000.0 * sr;
+    bool wasHalved = false;
+    while (maxLength > 0 && length > maxLength) {
+        length *= 0.5;
+        wasHalved = true;
+    }
+    if (halved != nullptr) *halved = wasHalved;
+    return int(std::round(length));
 }
 
-void GlitchPluginAudioProcessor::enableLFO(bool shouldBeEnabled)
+int GlitchPluginAudioProcessor::getRetroLookback(int offset) const
 {
-    stutterBuffer.setOrigRepeats(stutterBuffer.getStutterRepeats());
-    stutterBuffer.setOrigDuration(stutterBuffer.getStutterDuration());
-    stutterBuffer.setOrigRatio(stutterBuffer.getRatio());
-    lfo.enableLFO(shouldBeEnabled);
+    const int retro = juce::jlimit(0, 4, int(retroParam->load()));
+    if (retro == 0) return 0;
+
+    const int beats = 1 << (retro - 1);
+    const double samplesPerBeat = 60.0 * sr / juce::jmax(hostBpm, 1.0);
+    if (!ppqPosition.hasValue())
+        return int(std::round(beats * samplesPerBeat));
+
+    //the loop starts on the beat line closest to that many beats before the trigger
+    const double triggerBeat = *ppqPosition + offset / samplesPerBeat;
+    return int(std::round((triggerBeat - std::round(triggerBeat - beats)) * samplesPerBeat));
 }
 
-int GlitchPluginAudioProcessor::convertMsToSamples(float ms)
+int GlitchPluginAudioProcessor::getQuantizedTriggerOffset(int offset, int numSamples) const
 {
-    return (ms / 1000.f) * sr;
+    const auto& division = getDivision(quantizeDivisions, quantizeParam->load());
+    if (division.length <= 0.0 || !ppqPosition.hasValue())
+        return offset;
+
+    //the grid starts at the last bar line, so it stays in line with the bars whatever the time signature.
+    //a position a hair past a grid line still counts as on it, so rounding in the host does not delay the trigger by a whole step
+    const double samplesPerBeat = 60.0 * sr / juce::jmax(hostBpm, 1.0);
+    const double position = *ppqPosition + offset / samplesPerBeat;
+    const double gridSize = division.inBars ? division.length * beatsPerBar : division.length;
+    const double sinceBarStart = position - ppqOfLastBarStart;
+    const double nextLine = ppqOfLastBarStart + std::ceil(sinceBarStart / gridSize - 1.0e-6) * gridSize;
+
+    const int lineOffset = offset + int(std::round((nextLine - position) * samplesPerBeat));
+    return lineOffset < numSamples ? juce::jmax(offset, lineOffset) : -1;
 }
 
-void GlitchPluginAudioProcessor::modulateStutterParameters()
+void GlitchPluginAudioProcessor::modulateStutterParameters(int numSamples)
 {
+    //every parameter gets one modulated value per sample, the stutter buffer picks them up at the start of each span
+    const float* lfoValues = modulationBuffer.getReadPointer(lfoChannel);
+    float* durationValues = nullptr;
+    float* repeatValues = nullptr;
+    float* ratioValues = nullptr;
+
+    const float durationModDepth = durationModDepthParam->load();
+    const float repeatModDepth = repeatModDepthParam->load();
+    const float ratioModDepth = ratioModDepthParam->load();
+
     if (durationModDepth > 0.f) 
     {
-        float minValue = stutterBuffer.getOrigDuration() * (1 - durationModDepth);
-        int modulatedDurationInSamples = std::max(float(lfo.getCurrentValue() * durationModDepth * stutterBuffer.getOrigDuration() + minValue), float(convertMsToSamples(10.f)));
-        stutterBuffer.setStutterDurationInSamples(modulatedDurationInSamples);
+        float origDuration = stutterBuffer->getOrigDuration();
+        float minValue = origDuration * (1 - durationModDepth);
+        durationValues = modulationBuffer.getWritePointer(durationChannel);
+        juce::FloatVectorOperations::multiply(durationValues, lfoValues, float(durationModDepth * origDuration), numSamples);
+        juce::FloatVectorOperations::add(durationValues, minValue, numSamples);
+        juce::FloatVectorOperations::max(durationValues, durationValues, float(convertMsToSamples(10.f)), numSamples);
     }
     if (repeatModDepth > 0.f) {
-        float minValue = stutterBuffer.getOrigRepeats() * (1 - repeatModDepth);
-        stutterBuffer.setStutterRepeats(std::max(float(lfo.getCurrentValue() * repeatModDepth * stutterBuffer.getOrigRepeats()), 1.f));
+        repeatValues = modulationBuffer.getWritePointer(repeatsChannel);
+        juce::FloatVectorOperations::multiply(repeatValues, lfoValues, float(repeatModDepth * stutterBuffer->getOrigRepeats()), numSamples);
+        juce::FloatVectorOperations::max(repeatValues, repeatValues, 1.f, numSamples);
     }
     if (ratioModDepth > 0.f) {
         float minValue = -2.f;
-        float lfoValue = (lfo.getCurrentValue() * 2 - 1) * ratioModDepth;
-        stutterBuffer.setRatio(std::max(float(stutterBuffer.getOrigRatio()) + lfoValue, minValue));
+        //orig + (lfo * 2 - 1) * depth
+        ratioValues = modulationBuffer.getWritePointer(ratioChannel);
+        juce::FloatVectorOperations::multiply(ratioValues, lfoValues, float(2 * ratioModDepth), numSamples);
+        juce::FloatVectorOperations::add(ratioValues, float(stutterBuffer->getOrigRatio() - ratioModDepth), numSamples);
+        juce::FloatVectorOperations::max(ratioValues, ratioValues, minValue, numSamples);
     }
+
+    stutterBuffer->setModulation(durationValues, repeatValues, ratioValues);
+}
+
+void GlitchPluginAudioProcessor::parameterChanged(const juce::String&, float)
+{
+    triggerAsyncUpdate();
+}
+
+void GlitchPluginAudioProcessor::handleAsyncUpdate()
+{
+    if (getSampleRate() <= 0.0) return;
+
+    //the stutter buffer swaps its history on the audio thread at the start of the next block,
+    //the one for the other precision picks the group up when it is prepared
+    stutterBuffer->changeLinkGroup(int(linkGroupParam->load()));
+    stutterBuffer->setHistoryLength(int(historyLengthParam->load() * getSampleRate()));
 }
 
 void GlitchPluginAudioProcessor::updatePositionInfoForLFO(juce::AudioPlayHead* playhead)
@@ -9,13 +9,46 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include <bitset>
 #include "LFO.h"
 #include "StutterBuffer.h"
 
+//ids of the parameters in the value tree state
+namespace ParameterIDs
+{
+    inline constexpr const char* stutter = "stutter";
+    inline constexpr const char* duration = "duration";
+    inline constexpr const char* repeats = "repeats";
+    inline constexpr const char* ratio = "ratio";
+    inline constexpr const char* fadeShape = "fadeShape";
+    inline constexpr const char* highQuality = "highQuality";
+    inline constexpr const char* durationModDepth = "durationModDepth";
+    inline constexpr const char* repeatModDepth = "repeatModDepth";
+    inline constexpr const char* ratioModDepth = "ratioModDepth";
+    inline constexpr const char* lfoEnabled = "lfoEnabled";
+    inline constexpr const char* lfoFreq = "lfoFreq";
+    inline constexpr const char* lfoSync = "lfoSync";
+    inline constexpr const char* lfoSyncRate = "lfoSyncRate";
+    inline constexpr const char* linkGroup = "linkGroup";
+    inline constexpr const char* historyLength = "historyLength";
+    inline constexpr const char* sizeSync = "sizeSync";
+    inline constexpr const char* quantize = "quantize";
+    inline constexpr const char* retro = "retro";
+    inline constexpr const char* snapToOnset = "snapToOnset";
+    inline constexpr const char* granular = "granular";
+    inline constexpr const char* grainDensity = "grainDensity";
+    inline constexpr const char* grainSize = "grainSize";
+    inline constexpr const char* grainSpray = "grainSpray";
+    inline constexpr const char* grainPitch = "grainPitch";
+    inline constexpr const char* grainWindow = "grainWindow";
+}
+
 //==============================================================================
 /**
 */
-class GlitchPluginAudioProcessor  : public juce::AudioProcessor
+class GlitchPluginAudioProcessor  : public juce::AudioProcessor,
+                                    private juce::AudioProcessorValueTreeState::Listener,
+                                    private juce::AsyncUpdater
 {
 public:
     //==============================================================================
@@ -31,6 +64,19 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    void processBlockBypassed (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlockBypassed (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override { return true; }
+
+    //true while the synced size is longer than the history holds, the loop plays at half of it or less until the history has grown
+    bool isSizeHalved() const { return sizeHalved.load(); }
+
+    //host timeline positions of the onsets in the input since the last call, see StutterBufferBase::readOnsets
+    int readOnsets(juce::int64* positions, int maxNumOnsets) { return stutterBuffer->readOnsets(positions, maxNumOnsets); }
+
+    //applies a pending link group or history length change now, for callers without a message loop such as the console render
+    void applyPendingParameterChanges() { handleUpdateNowIfNeeded(); }
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -55,35 +101,157 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
     
-    void setStutterState(bool state);
-    void setStutterDuration(float durationInMs);
-    void setStutterRepeats(int repeats);
-    void setPlaybackRatio(double ratio);
-
+    juce::AudioProcessorValueTreeState& getValueTreeState() { return parameters; }
     LFO& getLFO() { return lfo; }
-    void enableLFO(bool shouldBeEnabled);
 
-    double durationModDepth = 0.0;
-    double repeatModDepth = 0.0;
-    double ratioModDepth = 0.0;
+   #if GLITCH_INSTRUMENTATION
+    //block timings of processBlock, to be polled from one thread
+    PerformanceMonitor& getPerformanceMonitor() { return performanceMonitor; }
+   #endif
+
 private:
     //==============================================================================
-    StutterBuffer stutterBuffer;
+    //one stutter buffer per sample type, prepareToPlay picks the one for the precision the host asked for
+    StutterBuffer<float> floatStutterBuffer;
+    StutterBuffer<double> doubleStutterBuffer;
+    StutterBufferBase* stutterBuffer = &floatStutterBuffer;
     LFO lfo;
 
+   #if GLITCH_INSTRUMENTATION
+    PerformanceMonitor performanceMonitor;
+   #endif
+
+    static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
+    juce::AudioProcessorValueTreeState parameters{ *this, nullptr, "Parameters", createParameterLayout() };
+
+    //raw parameter values, read once per block on the audio thread
+    std::atomic<float>* stutterParam = nullptr;
+    std::atomic<float>* durationParam = nullptr;
+    std::atomic<float>* repeatsParam = nullptr;
+    std::atomic<float>* ratioParam = nullptr;
+    std::atomic<float>* fadeShapeParam = nullptr;
+    std::atomic<float>* highQualityParam = nullptr;
+    std::atomic<float>* durationModDepthParam = nullptr;
+    std::atomic<float>* repeatModDepthParam = nullptr;
+    std::atomic<float>* ratioModDepthParam = nullptr;
+    std::atomic<float>* lfoEnabledParam = nullptr;
+    std::atomic<float>* lfoFreqParam = nullptr;
+    std::atomic<float>* lfoSyncParam = nullptr;
+    std::atomic<float>* lfoSyncRateParam = nullptr;
+    std::atomic<float>* linkGroupParam = nullptr;
+    std::atomic<float>* historyLengthParam = nullptr;
+    std::atomic<float>* sizeSyncParam = nullptr;
+    std::atomic<float>* quantizeParam = nullptr;
+    std::atomic<float>* retroParam = nullptr;
+    std::atomic<float>* snapToOnsetParam = nullptr;
+    std::atomic<float>* granularParam = nullptr;
+    std::atomic<float>* grainDensityParam = nullptr;
+    std::atomic<float>* grainSizeParam = nullptr;
+    std::atomic<float>* grainSprayParam = nullptr;
+    std::atomic<float>* grainPitchParam = nullptr;
+    std::atomic<float>* grainWindowParam = nullptr;
+
     std::atomic<float> stutterDuration{ 500.f };
     bool shouldRecordStutter = false;
     bool stutterDurationUpdated = false;
 
+    //per sample lfo values and the stutter parameters modulated from them, rendered once per block
+    enum ModulationChannel
+    {
+        lfoChannel,
+        durationChannel,
+        repeatsChannel,
+        ratioChannel,
+        numModulationChannels
+    };
+    juce::AudioBuffer<float> modulationBuffer;
+
+    //the stutter fades out over bypassFadeSeconds when the host bypasses the plugin and back in afterwards.
+    //there is no latency to match, so the dry signal is mixed in as it comes
+    static constexpr double bypassFadeSeconds = 0.01;
+    float wetGain = 1.f;
+    juce::AudioBuffer<float> dryFloatBuffer;
+    juce::AudioBuffer<double> dryDoubleBuffer;
+
+    //the block size the buffers above are prepared for
+    int maxBlockSize = 1;
+
     int sr;
     int convertMsToSamples(float ms);
 
+    //the stutter buffer keeps enough memory for one second of loop at this rate
+    static constexpr double maxSupportedSampleRate = 192000.0;
+
     juce::Optional<juce::AudioPlayHead::PositionInfo> playheadInfo;
     bool isPlaying = false;
 
-    void modulateStutterParameters();
+    //the values last sent to the stutter buffer, so only changes are posted
+    bool postedStutterState = false;
+    int postedDuration = -1;
+    double postedRatio = 1.0;
+
+    //midi notes from midiBaseNote upwards trigger stutter voices, see handleMidi
+    static constexpr int midiBaseNote = 60;
+    std::bitset<128> heldNotes;
+    //held notes that were let go but whose release did not fit into the queue yet
+    std::bitset<128> releasingNotes;
+    //quantized notes waiting for a grid line in a later block, with their velocities
+    std::bitset<128> pendingNotes;
+    std::array<float, 128> pendingVelocities{};
+    double hostBpm = 120.0;
+
+    //timeline position of the next block, from the host if it has one
+    juce::int64 samplePosition = 0;
+
+    //musical position of the block in quarter notes, synced sizes and quantized triggers need the host to report it
+    juce::Optional<double> ppqPosition;
+    double ppqOfLastBarStart = 0.0;
+    double beatsPerBar = 4.0;
+
+    //the size in samples, from the size parameter or the note division it is synced to
+    int getDurationInSamples();
+    //a synced length in samples, halved until the history holds it. halved tells if it had to be
+    int fitToHistory(float lengthInMs, bool* halved = nullptr) const;
+    std::atomic<bool> sizeHalved{ false };
+    //the sample from offset on in the next numSamples where a trigger at offset lands on the quantize grid,
+    //or -1 if the next grid line is further away
+    int getQuantizedTriggerOffset(int offset, int numSamples) const;
+    //how far before a trigger at offset its loop starts, 0 for the newest input
+    int getRetroLookback(int offset) const;
+
+    template <typename SampleType>
+    void processSamples(juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages, StutterBuffer<SampleType>& stutter,
+                        juce::AudioBuffer<SampleType>& dryBuffer, bool bypassed);
+    //one part of the block of at most maxBlockSize, with the midi events from midiStart up to midiEnd in the block
+    template <typename SampleType>
+    void processPart(juce::AudioBuffer<SampleType>& buffer, const juce::MidiBuffer& midiMessages, int midiStart, int midiEnd,
+                     StutterBuffer<SampleType>& stutter, juce::AudioBuffer<SampleType>& dryBuffer, bool bypassed);
+
+    void updateParameters();
+    void postStutterCommands(int numSamples, bool forceOff);
+    void handleMidi(const juce::MidiBuffer& midiMessages, int midiStart, int midiEnd, int numSamples);
+    StutterCommand createNoteTrigger(int note, float velocity, int offset) const;
+
+    //triggers and releases land at offsets inside the block, they are collected here and posted sorted by offset
+    //after the ones at the start of the block, since the stutter buffer does not go back to an earlier offset
+    struct BlockCommand
+    {
+        StutterCommand command;
+        //the midi note the command is for, -1 for the stutter parameter
+        int note;
+    };
+    std::array<BlockCommand, StutterCommandQueue::capacity> blockCommands;
+    int numBlockCommands = 0;
+    void addBlockCommand(const StutterCommand& command, int note);
+    void postBlockCommands();
+    void modulateStutterParameters(int numSamples);
     void updatePositionInfoForLFO(juce::AudioPlayHead* playhead);
 
+    //a new link group attaches the history of that group on the message thread and hands it to the audio thread.
+    //a new history length only changes how far the history grows, that is passed on right away
+    void parameterChanged(const juce::String& parameterID, float newValue) override;
+    void handleAsyncUpdate() override;
+
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GlitchPluginAudioProcessor)
 };
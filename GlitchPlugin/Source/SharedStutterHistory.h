@@ -0,0 +1,124 @@
+/*
+  ==============================================================================
+
+    SharedStutterHistory.h
+    Created: 17 Oct 2026 5:21:09pm
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include "AudioArena.h"
+#include "ChannelGroupBuffer.h"
+
+//an input history that all stutter buffers of a link group read their loops from, instead of each keeping its own ring.
+//the linked instances are expected to see the same input, so only one of them writes it and publishes how far it got,
+//the others only read what lies behind that. the first instance to write becomes the writer, another one takes over
+//once the writer falls too far behind, for example because its host stopped calling it.
+//positions are absolute sample positions on the host timeline
+template <typename SampleType>
+class SharedStutterHistory : public juce::ReferenceCountedObject
+{
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<SharedStutterHistory>;
+
+    //keeps every history that is in use, so instances in the same group and with the same layout find each other
+    class Registry
+    {
+    public:
+        //returns the history of the group, creating it if there is none with room for numSamples yet.
+        //allocates, so it must not be called on the audio thread
+        Ptr attach(int group, int numChannels, int numSamples)
+        {
+            const juce::ScopedLock sl(lock);
+
+            //a history only this registry refers to any more is no longer used by any instance
+            for (int i = histories.size(); --i >= 0;)
+                if (histories.getObjectPointerUnchecked(i)->getReferenceCount() == 1)
+                    histories.remove(i);
+
+            for (auto* history : histories)
+                if (history->group == group && history->ring.getNumChannels() == numChannels && history->ring.getNumSamples() >= numSamples)
+                    return history;
+
+            return histories.add(new SharedStutterHistory(group, numChannels, numSamples));
+        }
+
+    private:
+        juce::CriticalSection lock;
+        juce::ReferenceCountedArray<SharedStutterHistory> histories;
+    };
+
+    const ChannelGroupBuffer<SampleType>& getRing() const { return ring; }
+
+    //the end of the newest stretch of the timeline that has been written, every frame before it can be read
+    juce::int64 getWrittenEnd() const { return writtenEnd.load(std::memory_order_acquire); }
+
+    //writes source at position if instance is the writer, or takes over as the writer if there is none or the written end
+    //is more than takeoverDelay away from the end of source. returns false and writes nothing for every other instance.
+    //does not block, an instance that took over skips its block while the one before it still finishes its last one
+    bool write(const juce::AudioBuffer<SampleType>& source, juce::int64 position, const void* instance, int takeoverDelay)
+    {
+        const int numSamples = source.getNumSamples();
+        const juce::int64 end = position + numSamples;
+
+        const void* current = writer.load(std::memory_order_acquire);
+        if (current != instance)
+        {
+            const bool isStalled = current != nullptr && std::abs(end - writtenEnd.load(std::memory_order_relaxed)) > takeoverDelay;
+            if ((current != nullptr && !isStalled) || !writer.compare_exchange_strong(current, instance))
+                return false;
+        }
+
+        if (isWriting.exchange(true, std::memory_order_acquire))
+            return false;
+
+        const int ringSize = ring.getNumSamples();
+        int ringIndex = getRingIndex(position);
+
+        for (int done = 0; done < numSamples;)
+        {
+            const int numToDo = juce::jmin(numSamples - done, ringSize - ringIndex);
+            ring.copyFrom(source, done, ringIndex, numToDo);
+            done += numToDo;
+            ringIndex = 0;
+        }
+
+        //the frames are written before the end that lets the readers see them
+        writtenEnd.store(end, std::memory_order_release);
+        isWriting.store(false, std::memory_order_release);
+        return true;
+    }
+
+    //hands the writing over to whichever instance writes next, if instance is the writer
+    void releaseWriter(const void* instance)
+    {
+        writer.compare_exchange_strong(instance, nullptr);
+    }
+
+    //maps a timeline position to its index in the ring
+    int getRingIndex(juce::int64 position) const
+    {
+        const int index = int(position % ring.getNumSamples());
+        return index < 0 ? index + ring.getNumSamples() : index;
+    }
+
+private:
+    SharedStutterHistory(int linkGroup, int numChannels, int numSamples) : group(linkGroup)
+    {
+        arena.reserve(AudioArena::padded(ChannelGroupBuffer<SampleType>::getNumElements(numChannels, numSamples) * sizeof(SampleType)));
+        ring.setSize(numChannels, numSamples, arena.allocate<SampleType>(ChannelGroupBuffer<SampleType>::getNumElements(numChannels, numSamples)));
+    }
+
+    const int group;
+    AudioArena arena;
+    ChannelGroupBuffer<SampleType> ring;
+
+    std::atomic<const void*> writer{ nullptr };
+    std::atomic<bool> isWriting{ false };
+    std::atomic<juce::int64> writtenEnd{ 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(SharedStutterHistory)
+};
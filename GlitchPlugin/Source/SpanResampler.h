@@ -0,0 +1,375 @@
+/*
+  ==============================================================================
+
+    SpanResampler.h
+    Created: 17 Oct 2026 10:12:41am
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include "ChannelGroupBuffer.h"
+
+//selects the interpolation kernel of the stutter playback: 0 = linear, 1 = 4-point hermite, 2 = windowed sinc
+#ifndef GLITCH_RESAMPLER_KERNEL
+ #define GLITCH_RESAMPLER_KERNEL 0
+#endif
+
+namespace ResamplerKernels
+{
+    //every kernel reads getNumTaps samples from getFirstTap on around the read position, at most maxTaps
+    struct Linear
+    {
+        static constexpr int maxTaps = 2;
+        int getNumTaps() const { return maxTaps; }
+        int getFirstTap() const { return 0; }
+
+        void prepare() {}
+        void setStep(double) {}
+
+        void getWeights(float fraction, float* weights) const
+        {
+            weights[0] = 1.0f - fraction;
+            weights[1] = fraction;
+        }
+    };
+
+    struct Hermite
+    {
+        static constexpr int maxTaps = 4;
+        int getNumTaps() const { return maxTaps; }
+        int getFirstTap() const { return -1; }
+
+        void prepare() {}
+        void setStep(double) {}
+
+        void getWeights(float fraction, float* weights) const
+        {
+            const float f2 = fraction * fraction;
+            const float f3 = f2 * fraction;
+
+            weights[0] = -0.5f * f3 + f2 - 0.5f * fraction;
+            weights[1] = 1.5f * f3 - 2.5f * f2 + 1.0f;
+            weights[2] = -1.5f * f3 + 2.0f * f2 + 0.5f * fraction;
+            weights[3] = 0.5f * f3 - 0.5f * f2;
+        }
+    };
+
+    struct WindowedSinc
+    {
+        static constexpr int numTaps = 8;
+        static constexpr int firstTap = -3;
+        static constexpr int numPhases = 256;
+        static constexpr int maxTaps = numTaps;
+        int getNumTaps() const { return numTaps; }
+        int getFirstTap() const { return firstTap; }
+
+        //tabulates a blackman windowed sinc for numPhases + 1 fractional positions, each normalised to unity gain.
+        //the table does not depend on the sample rate, so it is only built the first time
+        void prepare()
+        {
+            if (table != nullptr) return;
+
+            table.allocate((numPhases + 1) * numTaps, false);
+
+            for (int phase = 0; phase <= numPhases; ++phase)
+            {
+                const float fraction = static_cast<float>(phase) / numPhases;
+                float* weights = table + phase * numTaps;
+                float sum = 0.0f;
+
+                for (int tap = 0; tap < numTaps; ++tap)
+                {
+                    const float x = static_cast<float>(firstTap + tap) - fraction;
+                    const float sinc = std::abs(x) < 1.0e-6f ? 1.0f : std::sin(juce::MathConstants<float>::pi * x) / (juce::MathConstants<float>::pi * x);
+                    const float w = juce::MathConstants<float>::pi * x / (numTaps / 2);
+                    const float window = 0.42f + 0.5f * std::cos(w) + 0.08f * std::cos(2.0f * w);
+                    weights[tap] = sinc * window;
+                    sum += weights[tap];
+                }
+
+                for (int tap = 0; tap < numTaps; ++tap)
+                    weights[tap] /= sum;
+            }
+        }
+
+        void setStep(double) {}
+
+        void getWeights(float fraction, float* weights) const
+        {
+            const float position = fraction * numPhases;
+            const int phase = juce::jmin(static_cast<int>(position), numPhases - 1);
+            const float alpha = position - phase;
+            const float* lower = table + phase * numTaps;
+            const float* upper = lower + numTaps;
+
+            for (int tap = 0; tap < numTaps; ++tap)
+                weights[tap] = lower[tap] + alpha * (upper[tap] - lower[tap]);
+        }
+
+    private:
+        juce::HeapBlock<float> table;
+    };
+
+    //blackman windowed sinc rows for a ladder of playback steps, built once and shared by every instance.
+    //a step of s input samples per output sample is cut off at 1 / s of the input nyquist, so its kernel reaches s times
+    //as far and has s times the taps. every table holds the weights of numPhases + 1 fractional positions, normalised to unity gain
+    struct BandLimitedSincTables
+    {
+        static constexpr int halfWidth = 8;
+        static constexpr int numPhases = 256;
+
+        //the steps go up by a quarter octave from 1 to maxStep, the fastest playback StutterBuffer allows
+        static constexpr int stepsPerOctave = 4;
+        static constexpr int maxStep = 16;
+        static constexpr int numTables = 4 * stepsPerOctave + 1;
+        static constexpr int maxTaps = 2 * halfWidth * maxStep;
+
+        struct Table
+        {
+            int numTaps;
+            int firstTap;
+            const float* rows;
+        };
+
+        BandLimitedSincTables()
+        {
+            size_t numElements = 0;
+            for (int index = 0; index < numTables; ++index)
+                numElements += size_t(getNumTaps(index) * (numPhases + 1));
+            weights.allocate(numElements, false);
+
+            float* rows = weights;
+            for (int index = 0; index < numTables; ++index)
+            {
+                const double step = getStep(index);
+                const int numTaps = getNumTaps(index);
+                const int firstTap = 1 - numTaps / 2;
+                tables[index] = { numTaps, firstTap, rows };
+
+                for (int phase = 0; phase <= numPhases; ++phase)
+                {
+                    const double fraction = static_cast<double>(phase) / numPhases;
+                    float* row = rows + phase * numTaps;
+                    double sum = 0.0;
+
+                    for (int tap = 0; tap < numTaps; ++tap)
+                    {
+                        //in output samples, where the cutoff is the nyquist frequency
+                        const double x = (firstTap + tap - fraction) / step;
+                        double weight = 0.0;
+                        if (std::abs(x) < halfWidth)
+                        {
+                            const double sinc = std::abs(x) < 1.0e-9 ? 1.0 : std::sin(juce::MathConstants<double>::pi * x) / (juce::MathConstants<double>::pi * x);
+                            const double w = juce::MathConstants<double>::pi * x / halfWidth;
+                            weight = sinc * (0.42 + 0.5 * std::cos(w) + 0.08 * std::cos(2.0 * w));
+                        }
+                        row[tap] = static_cast<float>(weight);
+                        sum += weight;
+                    }
+
+                    for (int tap = 0; tap < numTaps; ++tap)
+                        row[tap] = static_cast<float>(row[tap] / sum);
+                }
+
+                rows += numTaps * (numPhases + 1);
+            }
+        }
+
+        //the table of the smallest step at least as large as step, so it filters a little more than needed rather than alias
+        const Table& getTable(double step) const
+        {
+            const int index = step <= 1.0 ? 0 : static_cast<int>(std::ceil(std::log2(step) * stepsPerOctave - 1.0e-6));
+            return tables[juce::jlimit(0, numTables - 1, index)];
+        }
+
+    private:
+        static double getStep(int index) { return std::exp2(static_cast<double>(index) / stepsPerOctave); }
+        static int getNumTaps(int index) { return 2 * static_cast<int>(std::ceil(halfWidth * getStep(index) - 1.0e-9)); }
+
+        juce::HeapBlock<float> weights;
+        Table tables[numTables];
+    };
+
+    //windowed sinc whose cutoff follows the playback speed, so faster playback is filtered below the new nyquist.
+    //the weights come from the precomputed rows of the step, interpolated between the two nearest phases
+    struct BandLimitedSinc
+    {
+        static constexpr int maxTaps = BandLimitedSincTables::maxTaps;
+        int getNumTaps() const { return table->numTaps; }
+        int getFirstTap() const { return table->firstTap; }
+
+        void prepare() {}
+
+        void setStep(double step) { table = &tables->getTable(step); }
+
+        void getWeights(float fraction, float* weights) const
+        {
+            const float position = fraction * BandLimitedSincTables::numPhases;
+            const int phase = juce::jmin(static_cast<int>(position), BandLimitedSincTables::numPhases - 1);
+            const float alpha = position - phase;
+            const float* lower = table->rows + phase * table->numTaps;
+            const float* upper = lower + table->numTaps;
+
+            for (int tap = 0; tap < table->numTaps; ++tap)
+                weights[tap] = lower[tap] + alpha * (upper[tap] - lower[tap]);
+        }
+
+    private:
+        juce::SharedResourcePointer<BandLimitedSincTables> tables;
+        const BandLimitedSincTables::Table* table{ &tables->getTable(1.0) };
+    };
+}
+
+//a window of a ring buffer, read positions are clamped to [0, lastIndex] of the window
+template <typename SampleType>
+struct ResamplerSource
+{
+    const ChannelGroupBuffer<SampleType>* ring;
+    int startIndex;
+    int lastIndex;
+};
+
+//renders whole spans of a ring buffer window at a given playback speed, using a 32.32 fixed point phase,
+//so the read position stays exact however long the loop plays and in float as well as double.
+//read positions and kernel weights are worked out once per output sample and shared by all channels,
+//so the loop over the channel groups of the ring is only a gather of vectors and a short dot product
+template <typename Kernel>
+class SpanResampler
+{
+public:
+    static constexpr int fractionBits = 32;
+    static constexpr juce::int64 unity = juce::int64(1) << fractionBits;
+
+    static juce::int64 toPhase(double position) { return static_cast<juce::int64>(position * static_cast<double>(unity)); }
+
+    void prepare() { kernel.prepare(); }
+
+    //renders numSamples into dest, advancing the phase by increment per sample, and returns the phase after the span
+    template <typename SampleType>
+    juce::int64 render(const ResamplerSource<SampleType>& source, juce::AudioBuffer<SampleType>& dest, int destStart, int numSamples,
+                       juce::int64 phase, juce::int64 increment, bool reverse)
+    {
+        const int ringSize = source.ring->getNumSamples();
+        kernel.setStep(std::abs(static_cast<double>(increment)) / static_cast<double>(unity));
+        const int numTaps = kernel.getNumTaps();
+        const int firstTap = kernel.getFirstTap();
+        const juce::int64 lastPhase = juce::int64(source.lastIndex) << fractionBits;
+
+        for (int done = 0; done < numSamples;)
+        {
+            const int numToDo = juce::jmin(maxSpanSize, numSamples - done);
+
+            for (int i = 0; i < numToDo; ++i)
+            {
+                const juce::int64 position = juce::jlimit(juce::int64(0), lastPhase, reverse ? lastPhase - phase : phase);
+                const int index = static_cast<int>(position >> fractionBits);
+                const float fraction = static_cast<float>(position & (unity - 1)) * (1.0f / static_cast<float>(unity));
+
+                kernel.getWeights(fraction, weights + i * numTaps);
+
+                int* tapIndices = taps + i * numTaps;
+                for (int tap = 0; tap < numTaps; ++tap)
+                {
+                    int ringIndex = juce::jlimit(0, source.lastIndex, index + firstTap + tap) + source.startIndex;
+                    if (ringIndex >= ringSize) ringIndex -= ringSize;
+                    tapIndices[tap] = ringIndex;
+                }
+
+                phase += increment;
+            }
+
+            if (source.ring->isVectorised())
+                gatherVectors(*source.ring, dest, destStart + done, numToDo);
+            else if (source.ring->getGroupWidth() == 2)
+                gatherFrames<2>(*source.ring, dest, destStart + done, numToDo);
+            else
+                gatherFrames<1>(*source.ring, dest, destStart + done, numToDo);
+
+            done += numToDo;
+        }
+
+        return phase;
+    }
+
+private:
+    //long kernels render shorter spans, so the taps and weights of a span stay the same size
+    static constexpr int maxSpanSize = Kernel::maxTaps > 32 ? 4096 / Kernel::maxTaps : 128;
+
+    //sums the taps of a whole group per vector, and scatters the lanes that are channels into dest
+    template <typename SampleType>
+    void gatherVectors(const ChannelGroupBuffer<SampleType>& ring, juce::AudioBuffer<SampleType>& dest, int destStart, int numToDo) const
+    {
+        using Vector = typename ChannelGroupBuffer<SampleType>::Vector;
+        alignas(Vector::SIMDRegisterSize) SampleType frame[ChannelGroupBuffer<SampleType>::maxGroupWidth];
+        const int numTaps = kernel.getNumTaps();
+
+        for (int group = 0; group < ring.getNumGroups(); ++group)
+        {
+            const int firstChannel = group * ring.getGroupWidth();
+            const int numLanes = juce::jmin(ring.getNumChannelsInGroup(group), dest.getNumChannels() - firstChannel);
+            if (numLanes <= 0) break;
+
+            for (int i = 0; i < numToDo; ++i)
+            {
+                const int* tapIndices = taps + i * numTaps;
+                const float* tapWeights = weights + i * numTaps;
+                auto sum = Vector::expand(0.0f);
+
+                for (int tap = 0; tap < numTaps; ++tap)
+                    sum += Vector::fromRawArray(ring.getFrame(group, tapIndices[tap])) * static_cast<SampleType>(tapWeights[tap]);
+
+                sum.copyToRawArray(frame);
+                for (int lane = 0; lane < numLanes; ++lane)
+                    dest.getWritePointer(firstChannel + lane)[destStart + i] = frame[lane];
+            }
+        }
+    }
+
+    //the same for the planar and paired layouts of mono and stereo, which have no padding lanes to carry along
+    template <int groupWidth, typename SampleType>
+    void gatherFrames(const ChannelGroupBuffer<SampleType>& ring, juce::AudioBuffer<SampleType>& dest, int destStart, int numToDo) const
+    {
+        const int numTaps = kernel.getNumTaps();
+
+        for (int group = 0; group < ring.getNumGroups(); ++group)
+        {
+            const int firstChannel = group * groupWidth;
+            const int numLanes = juce::jmin(ring.getNumChannelsInGroup(group), dest.getNumChannels() - firstChannel);
+            if (numLanes <= 0) break;
+
+            for (int i = 0; i < numToDo; ++i)
+            {
+                const int* tapIndices = taps + i * numTaps;
+                const float* tapWeights = weights + i * numTaps;
+                SampleType sum[groupWidth]{};
+
+                for (int tap = 0; tap < numTaps; ++tap)
+                {
+                    const SampleType* frame = ring.getFrame(group, tapIndices[tap]);
+                    for (int lane = 0; lane < groupWidth; ++lane)
+                        sum[lane] += frame[lane] * static_cast<SampleType>(tapWeights[tap]);
+                }
+
+                for (int lane = 0; lane < numLanes; ++lane)
+                    dest.getWritePointer(firstChannel + lane)[destStart + i] = sum[lane];
+            }
+        }
+    }
+
+    Kernel kernel;
+    int taps[maxSpanSize * Kernel::maxTaps];
+    float weights[maxSpanSize * Kernel::maxTaps];
+};
+
+#if GLITCH_RESAMPLER_KERNEL == 2
+using StutterResampler = SpanResampler<ResamplerKernels::WindowedSinc>;
+#elif GLITCH_RESAMPLER_KERNEL == 1
+using StutterResampler = SpanResampler<ResamplerKernels::Hermite>;
+#else
+using StutterResampler = SpanResampler<ResamplerKernels::Linear>;
+#endif
+
+using HighQualityResampler = SpanResampler<ResamplerKernels::BandLimitedSinc>;
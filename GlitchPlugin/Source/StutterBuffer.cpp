@@ -10,238 +10,768 @@
 
 #include "StutterBuffer.h"
 
-StutterBuffer::StutterBuffer()
+void StutterBufferBase::setModulation(const float* duration, const float* repeats, const float* playbackRatio)
 {
-	targetDuration = maxStutterIndex;
-	targetRatio = ratio;
-	targetRepeats = stutterRepeats;
+	durationModulation = duration;
+	repeatsModulation = repeats;
+	ratioModulation = playbackRatio;
 }
 
-void StutterBuffer::prepareToPlay(int channels, int maximumStutterSize, int maxIndex)
+void StutterBufferBase::setStutterRepeats(float repeats)
 {
-	int ringBufferSize = maximumStutterSize * 4;
-	maxStutterIndex = maxIndex;
+	repeatsSmoother.setTargetValue(repeats);
+}
+
+template <typename SampleType>
+StutterBuffer<SampleType>::StutterBuffer()
+{
+	growthThread->addTimeSliceClient(this);
+}
+
+template <typename SampleType>
+StutterBuffer<SampleType>::~StutterBuffer()
+{
+	growthThread->removeTimeSliceClient(this);
+	if (attachedHistory != nullptr) attachedHistory->releaseWriter(this);
+}
+
+template <typename SampleType>
+int StutterBuffer<SampleType>::useTimeSlice()
+{
+	//the ring only allocates the chunk after the one being written, which takes the writer a good part of a second to fill.
+	//checks back after a while once that is there
+	return ringBuffer.allocateChunk() ? 0 : 100;
+}
+
+template <typename SampleType>
+void StutterBuffer<SampleType>::setHistoryLength(int numSamples)
+{
+	historyLength = numSamples;
+
+	//a linked instance does not grow the ring it is not using
+	if (linkGroup > 0) numSamples = 0;
+
+	const size_t bytesPerFrame = ChannelGroupBuffer<SampleType>::getChunkElements(ringBuffer.getNumChannels()) * sizeof(SampleType)
+							   / size_t(ChannelGroupBuffer<SampleType>::chunkSize);
+	const size_t budgetFrames = bytesPerFrame > 0 ? historyMemoryBudget / bytesPerFrame : 0;
+	ringBuffer.setTargetSize(int(juce::jmin(size_t(juce::jmax(0, numSamples)), budgetFrames)));
+}
+
+template <typename SampleType>
+size_t StutterBuffer<SampleType>::getArenaSize(int channels, int maximumStutterSize) const
+{
+	//a linked instance reads from the shared history and keeps no ring of its own
+	const size_t ringSize = linkGroup > 0 ? 0 : ChannelGroupBuffer<SampleType>::getNumElements(channels, maximumStutterSize * ringSizeInStutters);
+	const size_t fadeCurveSize = size_t(numFadeShapes * numFadeSamples);
+
+	return AudioArena::padded(ringSize * sizeof(SampleType))
+		 + 2 * AudioArena::padded(fadeCurveSize * sizeof(SampleType))
+		 + size_t(channels) * AudioArena::padded(size_t(numFadeSamples) * sizeof(SampleType))
+		 + size_t(channels) * AudioArena::padded(size_t(quantumSize) * sizeof(SampleType));
+}
+
+template <typename SampleType>
+void StutterBuffer<SampleType>::reserve(int channels, int maximumStutterSize)
+{
+	const size_t size = getArenaSize(juce::jlimit(1, maxNumChannels, channels), juce::jmax(1, maximumStutterSize));
+
+	//linking hands the memory of the own ring back
+	if (linkGroup > 0) arena.shrinkTo(size);
+	arena.reserve(size);
+}
+
+template <typename SampleType>
+void StutterBuffer<SampleType>::prepareToPlay(int channels, int maximumStutterSize, int maxIndex)
+{
+	jassert(channels <= maxNumChannels);
+	channels = juce::jlimit(1, maxNumChannels, channels);
+	maximumStutterSize = juce::jmax(1, maximumStutterSize);
+	int ringBufferSize = linkGroup > 0 ? 0 : maximumStutterSize * ringSizeInStutters;
+	durationSmoother.reset(float(maxIndex));
+	for (auto* smoother : { &durationSmoother, &repeatsSmoother, &ratioSmoother })
+		smoother->setRampLength(rampLength);
+	minCaptureLength = maximumStutterSize;
+	linkedReadBehind = maximumBlockSize;
+
+	//only allocates if this needs more than any earlier reserve or prepareToPlay
+	reserve(channels, maximumStutterSize);
+	arena.reset();
+
+	//a linked instance leaves room to grow its own ring in case it is unlinked while playing
+	ringBuffer.setSize(channels, ringBufferSize, arena.allocate<SampleType>(ChannelGroupBuffer<SampleType>::getNumElements(channels, ringBufferSize)),
+					   maximumStutterSize * maxHistoryInStutters);
+	maximumStutterLength = maximumStutterSize;
+	setHistoryLength(historyLength);
+	fadeInCurves = arena.allocate<SampleType>(size_t(numFadeShapes * numFadeSamples));
+	fadeOutCurves = arena.allocate<SampleType>(size_t(numFadeShapes * numFadeSamples));
+	for (int chan = 0; chan < channels; ++chan)
+		crossfadeChannels[chan] = arena.allocate<SampleType>(size_t(numFadeSamples));
+	crossfadeBuffer.setDataToReferTo(crossfadeChannels, channels, numFadeSamples);
+	for (int chan = 0; chan < channels; ++chan)
+		voiceChannels[chan] = arena.allocate<SampleType>(size_t(quantumSize));
+	voiceBuffer.setDataToReferTo(voiceChannels, channels, quantumSize);
+
+	if (attachedHistory != nullptr) attachedHistory->releaseWriter(this);
+	if (linkGroup > 0)
+		attachedHistory = historyRegistry->attach(linkGroup, channels, maximumStutterSize * linkedRingSizeInStutters);
+	else
+		attachedHistory = nullptr;
+
+	//the audio thread is not running, so it takes the history right away and nothing is left to hand over
+	sharedHistory = attachedHistory.get();
+	adoptedHistoryVersion = historyVersion.load();
+	acknowledgedHistoryVersion.store(adoptedHistoryVersion);
+	retiredHistories.clear();
+
+	buildFadeCurves();
+	resampler.prepare();
+	highQualityResampler.prepare();
+
+	ringWriteIndex = 0;
+	writtenPosition = 0;
+	updateMaxLoopLength();
+
+	onsets.clear();
+	markedEnd = std::numeric_limits<juce::int64>::min();
+	onsetDetector.prepare(sampleRate);
+	quantumPosition = 0;
+	grainCloud.reset();
+
+	for (auto& voice : voices)
+		stopVoice(voice);
+	mainVoice.loopLength = float(maxIndex);
+	mainVoice.captureLength = minCaptureLength;
+}
+
+template <typename SampleType>
+void StutterBuffer<SampleType>::changeLinkGroup(int group)
+{
+	group = juce::jmax(0, group);
+	if (group == linkGroup) return;
+	linkGroup = group;
+
+	//not prepared yet, prepareToPlay picks the group up
+	if (ringBuffer.getNumChannels() == 0) return;
+
+	//what the audio thread let go of is no longer read, what it still reads is kept until it has moved on
+	const int version = historyVersion.load();
+	if (acknowledgedHistoryVersion.load(std::memory_order_acquire) == version)
+		retiredHistories.clear();
+	if (attachedHistory != nullptr)
+		retiredHistories.add(attachedHistory.get());
+
+	attachedHistory = group > 0 ? historyRegistry->attach(group, ringBuffer.getNumChannels(), maximumStutterLength * linkedRingSizeInStutters) : nullptr;
+	pendingHistory.store(attachedHistory.get(), std::memory_order_release);
+	historyVersion.store(version + 1, std::memory_order_release);
+	setHistoryLength(historyLength);
+}
+
+template <typename SampleType>
+void StutterBuffer<SampleType>::adoptPendingHistory()
+{
+	const int version = historyVersion.load(std::memory_order_acquire);
+	if (version == adoptedHistoryVersion) return;
+
+	if (sharedHistory != nullptr) sharedHistory->releaseWriter(this);
+	sharedHistory = pendingHistory.load(std::memory_order_acquire);
+	adoptedHistoryVersion = version;
+	acknowledgedHistoryVersion.store(version, std::memory_order_release);
+
+	//windows and onsets of the old history mean nothing in the new one, the voices capture again from what comes in
+	for (auto& voice : voices)
+		voice.frozen = false;
+	grainCloud.reset();
+	onsets.clear();
+	onsetDetector.reset();
+	markedEnd = std::numeric_limits<juce::int64>::min();
+	ringWriteIndex = 0;
+	writtenPosition = 0;
+	updateMaxLoopLength();
+}
+
+template <typename SampleType>
+void StutterBuffer<SampleType>::process(juce::AudioBuffer<SampleType>& buffer)
+{
+	const int numSamples = buffer.getNumSamples();
+	int segmentStart = 0;
+	streamPosition = blockPosition;
+	adoptPendingHistory();
+
+	//every command splits the block at its sample offset, so it takes effect exactly there
+	StutterCommand command;
+	while (commandQueue.pop(command))
+	{
+		//offsets are clamped into the block and can not go back before the previous command
+		command.sampleOffset = juce::jlimit(segmentStart, numSamples, command.sampleOffset);
+		processSegment(buffer, segmentStart, command.sampleOffset - segmentStart);
+		segmentStart = command.sampleOffset;
+		handleCommand(command);
+	}
+	processSegment(buffer, segmentStart, numSamples - segmentStart);
+
+	setModulation(nullptr, nullptr, nullptr);
+	numDroppedGrains.fetch_add(grainCloud.takeNumDropped());
+}
+
+template <typename SampleType>
+void StutterBuffer<SampleType>::processSegment(juce::AudioBuffer<SampleType>& buffer, int segmentStart, int numSamples)
+{
+	if (numSamples <= 0) return;
+
+	//while no voice plays the output is the input, which only has to go into the ring, in one piece instead of per quantum.
+	//the ramps still step at every quantum start, so a later trigger sees the same values as without the shortcut
+	if (!hasActiveVoice())
+	{
+		juce::AudioBuffer<SampleType> segment(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), segmentStart, numSamples);
+		pushBuffer(segment);
+		streamPosition += numSamples;
+
+		for (int done = 0; done < numSamples;)
+		{
+			if (quantumPosition == 0) startQuantum(segmentStart + done);
+
+			const int numToDo = juce::jmin(numSamples - done, quantumSize - quantumPosition);
+			quantumPosition = (quantumPosition + numToDo) % quantumSize;
+			done += numToDo;
+		}
+		return;
+	}
+
+	//cuts the segment at the quantum grid, a quantum that started in the last block is finished first
+	while (numSamples > 0)
+	{
+		if (quantumPosition == 0) startQuantum(segmentStart);
 
-	ringBuffer.setSize(channels, ringBufferSize);
-	stutterBuffer.setSize(channels, maximumStutterSize);
+		const int numToDo = juce::jmin(numSamples, quantumSize - quantumPosition);
 
-	ringBuffer.clear();
-	stutterBuffer.clear();
+		//refers to the samples of the slice without copying or allocating
+		juce::AudioBuffer<SampleType> slice(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), segmentStart, numToDo);
+		processSlice(slice);
+
+		quantumPosition = (quantumPosition + numToDo) % quantumSize;
+		segmentStart += numToDo;
+		numSamples -= numToDo;
+	}
 }
 
-void StutterBuffer::process(juce::AudioBuffer<float>& buffer)
+template <typename SampleType>
+void StutterBuffer<SampleType>::processSlice(juce::AudioBuffer<SampleType>& slice)
 {
-	pushBuffer(buffer);
+	const int numSamples = slice.getNumSamples();
 
-	if (stutterState.get())
+	//the voices can wrap any number of times inside the slice, each span ends at the next wrap of any voice or at the end of the slice
+	for (int done = 0; done < numSamples;)
 	{
-		if (copyStutterToggle.get() || stutterBuffer.hasBeenCleared()) 
+		int numToDo = numSamples - done;
+
+		for (auto& voice : voices)
 		{
-			copyStutter();
+			if (!voice.active) continue;
+
+			//grains read from the newest input, a window frozen before would only hold the writer back
+			if (playsGrains(voice))
+			{
+				voice.frozen = false;
+				continue;
+			}
+
+			//a new loop ends exactly at the sample the voice was triggered on.
+			//the writer does not wait for the loop, one that is about to be overwritten starts over on newer input
+			if (!voice.frozen || isCaptureOverwritten(voice, quantumSize))
+			{
+				captureStutter(voice);
+				voice.currentRepeat = 0;
+			}
+
+			numToDo = juce::jlimit(0, numToDo, int(voice.loopLength) - voice.readIndex);
 		}
-		else 
+
+		if (numToDo > 0)
 		{
-			int numSamples = buffer.getNumSamples();
-			int maxSample = juce::jmin(numSamples, int(maxStutterIndex - stutterReadIndex));
-			bool paramsUpdated = anyParameterUpdated(numSamples);
+			juce::AudioBuffer<SampleType> span(slice.getArrayOfWritePointers(), slice.getNumChannels(), done, numToDo);
+
+			//the input goes into the ring before the first voice overwrites it, every other voice is added on top
+			pushBuffer(span);
 
-			for (int chan = buffer.getNumChannels(); --chan >= 0;)
+			bool isFirstVoice = true;
+			for (auto& voice : voices)
 			{
-				int readIndex = stutterReadIndex;
-				int repeats = currentRepeat;
+				if (!voice.active) continue;
 
-				for (int samp = 0; samp < maxSample; samp++)
+				if (isFirstVoice)
+					renderVoiceSpan(voice, span, 0, numToDo);
+				else
 				{
-					if (paramsUpdated) rampParameters();
-					float s = getInterpolatedSample(chan, readIndex);
-					if (readIndex >= maxStutterIndex - numFadeSamples) {
-						s += getCrossfadeSample(chan, readIndex, s);
-					}
-					buffer.setSample(chan, samp, s);
-					readIndex = readIndex + 1;
+					renderVoiceSpan(voice, voiceBuffer, 0, numToDo);
+					for (int chan = span.getNumChannels(); --chan >= 0;)
+						span.addFrom(chan, 0, voiceBuffer, chan, 0, numToDo);
 				}
+
+				isFirstVoice = false;
+				if (!playsGrains(voice)) voice.readIndex += numToDo;
 			}
 
-			if (maxSample < numSamples) 
+			streamPosition += numToDo;
+			done += numToDo;
+		}
+
+		for (auto& voice : voices)
+		{
+			if (!voice.active || playsGrains(voice) || voice.readIndex < int(voice.loopLength)) continue;
+
+			//a window the writer would reach during the next repeat is captured again instead, from the newest input
+			if (++voice.currentRepeat >= int(voice.repeats) || isCaptureOverwritten(voice, int(voice.loopLength) - numFadeSamples + quantumSize))
 			{
-				if (currentRepeat >= int(stutterRepeats - 1)) 
-				{
-					copyStutter();
-					currentRepeat = 0;
-				}
-				for (int chan = buffer.getNumChannels(); --chan >= 0;) 
-				{
-					for (int samp = 0; samp < numSamples - maxSample; samp++)
-					{
-						if (paramsUpdated) rampParameters();
-						buffer.setSample(chan, samp, getInterpolatedSample(chan, samp));
-					}
-				}
+				captureStutter(voice);
+				voice.currentRepeat = 0;
 			}
-			stutterReadIndex += numSamples;
-			if (stutterReadIndex >= maxStutterIndex)
+			else
 			{
-				currentRepeat = (currentRepeat + 1) % int(stutterRepeats);
-				stutterReadIndex = numFadeSamples;
+				//the head up to numFadeSamples was already crossfaded into the tail
+				voice.readIndex = numFadeSamples;
 			}
-			stutterReadIndex %= int(maxStutterIndex);
 		}
 	}
 }
 
-void StutterBuffer::pushBuffer(juce::AudioBuffer<float>& buf)
+template <typename SampleType>
+typename StutterBuffer<SampleType>::Voice* StutterBuffer<SampleType>::findVoice(int id)
 {
-	{
-		for (int chan = ringBuffer.getNumChannels(); --chan >= 0;)
-		{
-			int wIndex = ringWriteIndex;
-			for (int i = 0; i < buf.getNumSamples(); i++)
-			{
-				ringBuffer.setSample(chan, wIndex, buf.getSample(chan, i));
-				wIndex = (wIndex + 1) % ringBuffer.getNumSamples();
-			}
-		}
+	for (auto& voice : voices)
+		if (voice.active && voice.id == id)
+			return &voice;
 
-		ringWriteIndex += buf.getNumSamples();
-		ringWriteIndex %= ringBuffer.getNumSamples();
-	}
+	return nullptr;
 }
 
-void StutterBuffer::copyStutter()
+template <typename SampleType>
+typename StutterBuffer<SampleType>::Voice& StutterBuffer<SampleType>::startVoice(int id)
 {
-	for (int chan = ringBuffer.getNumChannels(); --chan >= 0;)
+	Voice* voice = id == 0 ? &mainVoice : findVoice(id);
+
+	//takes a free voice, or steals the one that started first
+	for (int i = 1; i < maxVoices && voice == nullptr; ++i)
+		if (!voices[size_t(i)].active)
+			voice = &voices[size_t(i)];
+
+	if (voice == nullptr)
 	{
-		int readSampleIndex = ringWriteIndex; 
-		for (int i = stutterBuffer.getNumSamples(); --i >= 0;)
-		{
-			int destSampleIndex = i;
-			readSampleIndex = (readSampleIndex - 1 + ringBuffer.getNumSamples()) % ringBuffer.getNumSamples();
-			stutterBuffer.setSample(chan, destSampleIndex, ringBuffer.getSample(chan, readSampleIndex));
-		}
+		voice = &voices[1];
+		for (int i = 2; i < maxVoices; ++i)
+			if (voices[size_t(i)].order < voice->order)
+				voice = &voices[size_t(i)];
 	}
 
-	applyFade();
-	stutterReadIndex = 0;
-	copyStutterToggle.set(false);
+	stopVoice(*voice);
+	voice->id = id;
+	voice->active = true;
+	voice->order = nextVoiceOrder++;
+	return *voice;
 }
 
-float StutterBuffer::getInterpolatedSample(int channel, int currentIndex)
+template <typename SampleType>
+bool StutterBuffer<SampleType>::hasActiveVoice() const
 {
-	double absRatio = std::abs(ratio);
-	float inputIdx = currentIndex / absRatio;
+	for (const auto& voice : voices)
+		if (voice.active)
+			return true;
+
+	return false;
+}
 
-	int x1 = static_cast<int>(std::floor(inputIdx));
-	int x2 = x1 + 1;
-	if (x1 >= maxStutterIndex - 1) x1 = maxStutterIndex - 1;
-	if (x2 >= maxStutterIndex) x2 = maxStutterIndex - 1;
-	float fraction = inputIdx - x1;
+template <typename SampleType>
+void StutterBuffer<SampleType>::stopVoice(Voice& voice)
+{
+	voice.active = false;
+	voice.frozen = false;
+	voice.readIndex = 0;
+	voice.currentRepeat = 0;
+}
 
-	if (ratio < 0.0)
+template <typename SampleType>
+void StutterBuffer<SampleType>::handleCommand(const StutterCommand& command)
+{
+	switch (command.type)
+	{
+	case StutterCommand::Trigger:
 	{
-		x1 = maxStutterIndex - 1 - x1;
-		x2 = maxStutterIndex - 1 - x2;
-		if (x1 <= 0) x1 = 0;
-		if (x2 <= 0) x2 = 0;
+		//the loop is captured at the sample the command lands on
+		Voice& voice = startVoice(command.voice);
+		voice.lookback = int(command.value);
+		if (&voice == &mainVoice) grainCloud.reset();
+		if (command.voice != 0)
+		{
+			voice.duration = command.duration;
+			voice.ratio = limitRatio(command.ratio);
+			voice.repeats = repeatsSmoother.getTargetValue();
+		}
+		break;
+	}
+	case StutterCommand::Release:
+		if (command.voice < 0)
+		{
+			for (int i = 1; i < maxVoices; ++i)
+				stopVoice(voices[size_t(i)]);
+		}
+		else if (Voice* voice = findVoice(command.voice))
+			stopVoice(*voice);
+		break;
+	case StutterCommand::Recapture:
+		if (Voice* voice = findVoice(command.voice))
+		{
+			voice->lookback = int(command.value);
+			captureStutter(*voice);
+			voice->currentRepeat = 0;
+		}
+		break;
+	case StutterCommand::SetDuration:
+		//the fade out follows the loop length while reading, so the new duration only has to be ramped to
+		durationSmoother.setTargetValue(command.value);
+		break;
+	case StutterCommand::SetRatio:
+		ratioSmoother.setTargetValue(command.value);
+		break;
 	}
-	float y1 = stutterBuffer.getSample(channel, x1);
-	float y2 = stutterBuffer.getSample(channel, x2);
-
-	return y1 + fraction * (y2 - y1);
 }
 
-bool StutterBuffer::anyParameterUpdated(int numSamples)
+template <typename SampleType>
+void StutterBuffer<SampleType>::pushBuffer(juce::AudioBuffer<SampleType>& buf)
 {
-	bool updated = false;
+	GLITCH_MEASURE_STAGE(performanceMonitor, ringWrite);
 
-	if (!juce::approximatelyEqual(int(targetDuration), int(maxStutterIndex)))
+	if (sharedHistory != nullptr)
 	{
-		durRampIncrement = (targetDuration - maxStutterIndex) / numSamples;
-		updated = true;
+		//only the writer of the group writes, every instance marks the onsets in what has been written since its last block
+		sharedHistory->write(buf, streamPosition, this, minCaptureLength);
+
+		const juce::int64 writtenEnd = sharedHistory->getWrittenEnd();
+		const juce::int64 markStart = markedEnd > writtenEnd ? writtenEnd - buf.getNumSamples() : juce::jmax(markedEnd, writtenEnd - buf.getNumSamples());
+		if (markStart < writtenEnd)
+			markOnsets(sharedHistory->getRing(), sharedHistory->getRingIndex(markStart), int(writtenEnd - markStart), markStart, markStart);
+		return;
+	}
+
+	//a ring that was left empty while linked starts out with the first chunk the growth thread allocates
+	if (ringBuffer.getNumSamples() == 0)
+	{
+		if (!ringBuffer.grow()) return;
+		updateMaxLoopLength();
 	}
-	if (!juce::approximatelyEqual(int(targetRepeats), int(stutterRepeats))) {
-		repeatsRampIncrement = (targetRepeats - stutterRepeats) / numSamples;
-		updated = true;
+	const int ringSize = ringBuffer.getNumSamples();
+
+	int numSamples = buf.getNumSamples();
+	int readOffset = 0;
+
+	//a block longer than the ring only leaves its newest samples behind
+	if (numSamples > ringSize)
+	{
+		readOffset = numSamples - ringSize;
+		ringWriteIndex = (ringWriteIndex + readOffset) % ringSize;
+		writtenPosition += readOffset;
+		numSamples = ringSize;
 	}
-	if (!juce::approximatelyEqual(targetRatio, ratio)) {
-		ratioRampIncrement = (targetRatio - ratio) / numSamples;
-		updated = true;
+
+	//writes up to the end of the ring at a time. there the ring takes on the next chunk the growth thread has
+	//allocated, and otherwise wraps around. the writer never waits for a voice, voices recapture before it reaches
+	//their window, so no window reaches across the end of the ring when it grows
+	while (numSamples > 0)
+	{
+		if (ringWriteIndex == ringBuffer.getNumSamples())
+		{
+			if (ringBuffer.grow())
+				updateMaxLoopLength();
+			else
+				ringWriteIndex = 0;
+		}
+
+		const int numToWrite = juce::jmin(numSamples, ringBuffer.getNumSamples() - ringWriteIndex);
+
+		ringBuffer.copyFrom(buf, readOffset, ringWriteIndex, numToWrite);
+		markOnsets(ringBuffer, ringWriteIndex, numToWrite, writtenPosition, streamPosition + readOffset);
+		ringWriteIndex += numToWrite;
+		writtenPosition += numToWrite;
+		readOffset += numToWrite;
+		numSamples -= numToWrite;
 	}
-	return updated;
 }
 
-void StutterBuffer::rampParameters()
+template <typename SampleType>
+void StutterBuffer<SampleType>::markOnsets(const ChannelGroupBuffer<SampleType>& ring, int ringIndex, int numSamples, juce::int64 position, juce::int64 timelinePosition)
 {
-	if (!juce::approximatelyEqual(int(targetDuration), int(maxStutterIndex))) {
-		maxStutterIndex += durRampIncrement;
+	//a timeline that jumps back leaves the marks behind it meaningless
+	if (position < markedEnd)
+	{
+		onsets.clear();
+		onsetDetector.reset();
 	}
-	if (!juce::approximatelyEqual(int(targetRepeats), int(stutterRepeats))) {
-		stutterRepeats += repeatsRampIncrement;
+	markedEnd = position + numSamples;
+
+	onsetDetector.process(ring, ringIndex, numSamples, [&](int offset)
+	{
+		onsets.add(position + offset);
+		publishOnset(timelinePosition + offset);
+	});
+}
+
+template <typename SampleType>
+void StutterBuffer<SampleType>::captureStutter(Voice& voice)
+{
+	GLITCH_MEASURE_STAGE(performanceMonitor, capture);
+
+	//the main voice follows the duration ramp, every other voice keeps the duration it was triggered with
+	const float duration = &voice == &mainVoice ? durationSmoother.getTargetValue() : voice.duration;
+
+	//loops longer than the minimum reach further back, as long as they take at most half of the history
+	const int historySize = sharedHistory != nullptr ? sharedHistory->getRing().getNumSamples() : ringBuffer.getNumSamples();
+	const int maxReach = getMaxReach(historySize);
+	voice.captureLength = juce::jlimit(minCaptureLength, maxReach, int(duration));
+
+	//an own ring that has not grown far enough yet has nothing to loop, the voice stays silent until it has
+	if (!hasRoomForLoop(historySize))
+	{
+		voice.frozen = false;
+		voice.readIndex = 0;
+		return;
 	}
-	if (!juce::approximatelyEqual(std::round(targetRatio * 10) / 10, std::round(ratio * 10) / 10)) {
-		ratio += ratioRampIncrement;
+
+	//the loop starts lookback back, but at least a loop length, so it always ends in input that has been written
+	const juce::int64 historyEnd = sharedHistory != nullptr ? getLinkedHistoryEnd(streamPosition) : writtenPosition;
+	juce::int64 start = historyEnd - juce::jlimit(voice.captureLength, maxReach, voice.lookback);
+
+	if (snapToOnset.load())
+	{
+		const juce::int64 onset = onsets.findNearest(start, juce::jmax(start - voice.captureLength / 2, historyEnd - maxReach),
+													 juce::jmin(start + voice.captureLength / 2, historyEnd - voice.captureLength));
+		if (onset >= 0) start = onset;
+	}
+
+	if (sharedHistory != nullptr)
+	{
+		voice.captureStartPosition = start;
+		voice.captureStartIndex = sharedHistory->getRingIndex(voice.captureStartPosition);
 	}
+	else
+	{
+		//freezes the window in place instead of copying it out of the ring
+		voice.captureStartIndex = ringWriteIndex - int(historyEnd - start);
+		if (voice.captureStartIndex < 0) voice.captureStartIndex += historySize;
+	}
+
+	if (&voice != &mainVoice)
+		voice.loopLength = juce::jlimit(float(numFadeSamples + 1), float(juce::jmax(numFadeSamples + 1, voice.captureLength)), duration);
+
+	voice.frozen = true;
+	voice.readIndex = 0;
 }
 
-void StutterBuffer::applyFade()
+template <typename SampleType>
+void StutterBuffer<SampleType>::updateMaxLoopLength()
 {
-	for (int chan = stutterBuffer.getNumChannels(); --chan >= 0;) {
+	const int historySize = sharedHistory != nullptr ? sharedHistory->getRing().getNumSamples() : ringBuffer.getNumSamples();
+	maxLoopLength.store(hasRoomForLoop(historySize) ? getMaxReach(historySize) : 0, std::memory_order_relaxed);
+}
 
-		auto* data = stutterBuffer.getWritePointer(chan);
-		//fade in
-		for (int i = 0; i < numFadeSamples; ++i) {
-			data[i] *= static_cast<float>(i) / numFadeSamples;
-		}
+template <typename SampleType>
+bool StutterBuffer<SampleType>::isCaptureOverwritten(const Voice& voice, int numSamples) const
+{
+	if (!voice.frozen) return false;
+
+	//keeps a loop of room. goes by the own position instead of the written end, which depends on whether the writer ran first,
+	//and leaves room for the writer to be up to two of the longest blocks further ahead
+	if (sharedHistory != nullptr)
+		return streamPosition + 2 * linkedReadBehind + numSamples - voice.captureStartPosition > sharedHistory->getRing().getNumSamples() - voice.captureLength;
+
+	//the window lies behind the writer, which comes round to its start after the rest of the ring
+	int freeSpace = voice.captureStartIndex - ringWriteIndex;
+	if (freeSpace <= 0) freeSpace += ringBuffer.getNumSamples();
+	return freeSpace < numSamples;
+}
+
+template <typename SampleType>
+ResamplerSource<SampleType> StutterBuffer<SampleType>::getCaptureSource(const Voice& voice) const
+{
+	return { sharedHistory != nullptr ? &sharedHistory->getRing() : &ringBuffer, voice.captureStartIndex, juce::jmin(int(voice.loopLength), voice.captureLength) - 1 };
+}
 
-		//fade out
-		for (int i = 0; i < numFadeSamples; ++i)
+template <typename SampleType>
+juce::int64 StutterBuffer<SampleType>::renderCapture(const Voice& voice, juce::AudioBuffer<SampleType>& dest, int destStart, int loopIndex, int numSamples)
+{
+	//a loop index maps to the captured position loopIndex / |ratio|, played backwards for negative ratios
+	const juce::int64 increment = StutterResampler::toPhase(1.0 / std::abs(voice.ratio));
+
+	if (isHighQuality() && increment != StutterResampler::unity)
+		return highQualityResampler.render(getCaptureSource(voice), dest, destStart, numSamples, increment * loopIndex, increment, voice.ratio < 0.0f);
+
+	return resampler.render(getCaptureSource(voice), dest, destStart, numSamples, increment * loopIndex, increment, voice.ratio < 0.0f);
+}
+
+template <typename SampleType>
+float StutterBuffer<SampleType>::limitRatio(float ratio)
+{
+	//keeps the sign, a ratio of exactly 0 plays forwards
+	return std::copysign(juce::jmax(minRatio, std::abs(ratio)), ratio);
+}
+
+template <typename SampleType>
+void StutterBuffer<SampleType>::startQuantum(int blockOffset)
+{
+	//a modulated parameter takes the lfo value and ramps back to its target once the lfo lets go
+	auto next = [blockOffset](BlockSmoothedValue& smoother, const float* modulation)
+	{
+		if (modulation != nullptr)
 		{
-			const int idx = maxStutterIndex - numFadeSamples + i;
-			data[idx] *= 1.0f - static_cast<float>(i) / numFadeSamples;
+			const float target = smoother.getTargetValue();
+			smoother.reset(modulation[blockOffset]);
+			smoother.setTargetValue(target);
+			return modulation[blockOffset];
 		}
+
+		const float value = smoother.getCurrentValue();
+		smoother.skip(quantumSize);
+		return value;
+	};
+
+	//the loop has to be longer than its fade in, so a wrap always moves the read position forward,
+	//and can not play past the end of the window it captured
+	mainVoice.loopLength = juce::jlimit(float(numFadeSamples + 1), float(juce::jmax(numFadeSamples + 1, mainVoice.captureLength)),
+										next(durationSmoother, durationModulation));
+	mainVoice.repeats = next(repeatsSmoother, repeatsModulation);
+	mainVoice.ratio = limitRatio(next(ratioSmoother, ratioModulation));
+
+	//a cloud that starts over does not pick up grains it left behind
+	const bool wasGranular = granularQuantum;
+	granularQuantum = granular.load();
+	if (granularQuantum && !wasGranular) grainCloud.reset();
+	grainCloud.beginQuantum();
+
+	grainSettings.interval = float(sampleRate) / juce::jmax(1.0f, grainDensity.load());
+	grainSettings.length = juce::jmax(2.0f, grainLength.load());
+	grainSettings.spray = juce::jmax(0.0f, grainSpray.load());
+	grainSettings.speed = 1.0f / mainVoice.ratio;
+	grainSettings.pitchSpread = grainPitchSpread.load();
+	grainSettings.window = juce::jlimit(0, int(GrainWindows::numShapes), grainWindow.load());
+}
+
+template <typename SampleType>
+void StutterBuffer<SampleType>::buildFadeCurves()
+{
+	for (int i = 0; i < numFadeSamples; ++i)
+	{
+		const SampleType t = static_cast<SampleType>(i) / numFadeSamples;
+		const SampleType halfPiT = juce::MathConstants<SampleType>::halfPi * t;
+		const SampleType raisedCosine = SampleType(0.5) - SampleType(0.5) * std::cos(juce::MathConstants<SampleType>::pi * t);
+
+		fadeInCurves[Linear * numFadeSamples + i] = t;
+		fadeOutCurves[Linear * numFadeSamples + i] = SampleType(1) - t;
+		fadeInCurves[EqualPower * numFadeSamples + i] = std::sin(halfPiT);
+		fadeOutCurves[EqualPower * numFadeSamples + i] = std::cos(halfPiT);
+		fadeInCurves[RaisedCosine * numFadeSamples + i] = raisedCosine;
+		fadeOutCurves[RaisedCosine * numFadeSamples + i] = SampleType(1) - raisedCosine;
 	}
 }
 
-float StutterBuffer::getCrossfadeSample(int chan, int index, float sample)
+template <typename SampleType>
+void StutterBuffer<SampleType>::renderVoiceSpan(const Voice& voice, juce::AudioBuffer<SampleType>& buffer, int startSample, int numSamples)
 {
-	int crossFadeIdx = index - (maxStutterIndex - numFadeSamples);
-	return getInterpolatedSample(chan, crossFadeIdx);
+	if (playsGrains(voice))
+		renderGrains(buffer, startSample, numSamples);
+	else
+		renderLoopSpan(voice, buffer, startSample, numSamples);
 }
 
-void StutterBuffer::setStutterDurationInSamples(int numSamples)
+template <typename SampleType>
+void StutterBuffer<SampleType>::renderGrains(juce::AudioBuffer<SampleType>& buffer, int startSample, int numSamples)
 {
-	if (!juce::approximatelyEqual(int(maxStutterIndex), numSamples)) {
-		targetDuration = numSamples;
-		//fade out
-		for (int chan = stutterBuffer.getNumChannels(); --chan >= 0;) {
-			auto* data = stutterBuffer.getWritePointer(chan);
-			for (int i = 0; i < numFadeSamples; ++i)
-			{
-				const int idx = targetDuration - numFadeSamples + i;
-				data[idx] *= 1.0f - static_cast<float>(i) / numFadeSamples;
-			}
-		}
+	GLITCH_MEASURE_STAGE(performanceMonitor, grains);
+
+	const auto& ring = sharedHistory != nullptr ? sharedHistory->getRing() : ringBuffer;
+	const int historySize = ring.getNumSamples();
+	if (historySize == 0)
+	{
+		buffer.clear(startSample, numSamples);
 		return;
 	}
-	targetDuration = numSamples;
-	maxStutterIndex = numSamples;
+
+	//the span is in the history already, grains reach back at most half of it like a captured loop
+	const juce::int64 historyEnd = sharedHistory != nullptr ? getLinkedHistoryEnd(streamPosition + numSamples) : streamPosition + numSamples;
+	const int maxReach = juce::jmax(1, historySize / 2);
+
+	grainCloud.render(buffer, startSample, numSamples, grainSettings, ring.getGroupWidth(), [&](int lookback, int numFrames)
+	{
+		lookback = juce::jlimit(1, maxReach, lookback);
+
+		int startIndex;
+		if (sharedHistory != nullptr)
+			startIndex = sharedHistory->getRingIndex(historyEnd - lookback);
+		else
+		{
+			startIndex = ringWriteIndex - lookback;
+			if (startIndex < 0) startIndex += historySize;
+		}
+
+		return ResamplerSource<SampleType>{ &ring, startIndex, juce::jlimit(0, lookback - 1, numFrames - 1) };
+	});
 }
 
-void StutterBuffer::setStutterRepeats(float repeats)
+template <typename SampleType>
+void StutterBuffer<SampleType>::renderLoopSpan(const Voice& voice, juce::AudioBuffer<SampleType>& buffer, int startSample, int numSamples)
 {
-	if (!juce::approximatelyEqual(stutterRepeats, repeats)) {
-		targetRepeats = repeats;
+	if (numSamples <= 0) return;
+
+	if (!voice.frozen)
+	{
+		buffer.clear(startSample, numSamples);
 		return;
 	}
-	targetRepeats = repeats;
-	stutterRepeats = repeats;
+
+	{
+		GLITCH_MEASURE_STAGE(performanceMonitor, resample);
+		renderCapture(voice, buffer, startSample, voice.readIndex, numSamples);
+	}
+
+	//the fade also renders the head of the loop it crossfades into the tail
+	GLITCH_MEASURE_STAGE(performanceMonitor, fade);
+	applyFade(voice, buffer, startSample, numSamples);
 }
 
-void StutterBuffer::setRatio(float playbackRatio)
+template <typename SampleType>
+void StutterBuffer<SampleType>::applyFade(const Voice& voice, juce::AudioBuffer<SampleType>& buffer, int startSample, int numSamples)
 {
-	if (!juce::approximatelyEqual(ratio, playbackRatio)) {
-		targetRatio = playbackRatio;
-		return;
+	const int loopIndex = voice.readIndex;
+	const int shapeOffset = getFadeShape() * numFadeSamples;
+	const SampleType* fadeIn = fadeInCurves + shapeOffset;
+	const SampleType* fadeOut = fadeOutCurves + shapeOffset;
+
+	//fade in over the first numFadeSamples of the loop
+	if (loopIndex < numFadeSamples)
+	{
+		const int numToFade = juce::jmin(numSamples, numFadeSamples - loopIndex);
+		for (int chan = buffer.getNumChannels(); --chan >= 0;)
+			juce::FloatVectorOperations::multiply(buffer.getWritePointer(chan, startSample), fadeIn + loopIndex, numToFade);
+	}
+
+	//the tail of the loop is faded out and mixed with the faded in head, so the next repeat starts seamlessly
+	const int fadeOutStart = int(voice.loopLength) - numFadeSamples;
+	const int crossfadeStart = juce::jmax(loopIndex, fadeOutStart);
+	const int crossfadeEnd = juce::jmin(loopIndex + numSamples, int(voice.loopLength));
+
+	if (crossfadeStart < crossfadeEnd)
+	{
+		const int numToMix = crossfadeEnd - crossfadeStart;
+		const int headIndex = crossfadeStart - fadeOutStart;
+		const int outOffset = startSample + crossfadeStart - loopIndex;
+
+		renderCapture(voice, crossfadeBuffer, 0, headIndex, numToMix);
+
+		for (int chan = buffer.getNumChannels(); --chan >= 0;)
+		{
+			auto* head = crossfadeBuffer.getReadPointer(chan);
+			auto* out = buffer.getWritePointer(chan, outOffset);
+			juce::FloatVectorOperations::multiply(out, fadeOut + headIndex, numToMix);
+			juce::FloatVectorOperations::addWithMultiply(out, head, fadeIn + headIndex, numToMix);
+		}
 	}
-	targetRatio = playbackRatio;
-	ratio = playbackRatio;
-}
\ No newline at end of file
+}
+
+template class StutterBuffer<float>;
+template class StutterBuffer<double>;
@@ -10,25 +10,122 @@
 
 #pragma once
 #include <JuceHeader.h>
+#include "SpanResampler.h"
+#include "BlockSmoothedValue.h"
+#include "StutterCommandQueue.h"
+#include "AudioArena.h"
+#include "SharedStutterHistory.h"
+#include "PerformanceMonitor.h"
+#include "HistoryIndex.h"
+#include "OnsetDetector.h"
+#include "GrainCloud.h"
 
 
-class StutterBuffer
+//allocates the chunks stutter buffers grow their history by, shared by every instance
+struct HistoryGrowthThread : public juce::TimeSliceThread
+{
+    HistoryGrowthThread() : juce::TimeSliceThread("Stutter history growth") { startThread(); }
+    ~HistoryGrowthThread() override { stopThread(1000); }
+};
+
+//the controls of a stutter buffer, which do not depend on the sample type it processes
+class StutterBufferBase
 {
 public:
-    StutterBuffer();
+    virtual ~StutterBufferBase() = default;
+
+    enum FadeShape
+    {
+        Linear,
+        EqualPower,
+        RaisedCosine,
+        numFadeShapes
+    };
+
+    //channel count up to which prepareToPlay is expected to be called, enough for 7.1.4 and third order ambisonics
+    static constexpr int maxNumChannels = 16;
+
+    //0 keeps a history of its own, any other group reads from the history of that group, shared with other instances.
+    //takes effect with the next reserve or prepareToPlay
+    void setLinkGroup(int group) { linkGroup = juce::jmax(0, group); }
+    int getLinkGroup() const { return linkGroup; }
+
+    //moves a prepared stutter buffer to the history of another group while the audio thread keeps calling process,
+    //which picks the history up at the start of its next block. allocates, so it is called on the message thread
+    virtual void changeLinkGroup(int group) = 0;
+
+    //the onset detector works in seconds, takes effect with the next prepareToPlay
+    void setSampleRate(double newSampleRate) { sampleRate = newSampleRate; }
+
+    //moves the start of each captured loop to the nearest onset in the input, if there is one within half a loop
+    void setSnapToOnset(bool shouldSnap) { snapToOnset.store(shouldSnap); }
+
+    //takes up to maxNumOnsets host timeline positions of onsets the input had since the last call, oldest first.
+    //onsets that come faster than they are read are dropped. to be called from one thread
+    int readOnsets(juce::int64* positions, int maxNumOnsets)
+    {
+        const auto scope = onsetFifo.read(juce::jmin(maxNumOnsets, onsetFifo.getNumReady()));
+        std::copy_n(onsetPositions.begin() + scope.startIndex1, scope.blockSize1, positions);
+        std::copy_n(onsetPositions.begin() + scope.startIndex2, scope.blockSize2, positions + scope.blockSize1);
+        return scope.blockSize1 + scope.blockSize2;
+    }
+
+    //the host timeline position of the first sample of the next process call, linked instances line up their input with it
+    void setBlockPosition(juce::int64 position) { blockPosition = position; }
+
+    //the longest block process is called with, to be set before prepareToPlay.
+    //linked instances read their loops this far behind their position, whatever the size of the block at hand
+    void setMaximumBlockSize(int numSamples) { maximumBlockSize = juce::jmax(1, numSamples); }
+
+    //how much input the own ring keeps at most, it grows there in chunks allocated on a background thread
+    //as the input comes in. limited by the memory budget, and never shorter than the ring prepareToPlay sets up
+    virtual void setHistoryLength(int numSamples) = 0;
+
+    //bytes the history of one instance may grow to
+    void setHistoryMemoryBudget(size_t numBytes) { historyMemoryBudget = numBytes; }
 
-    void prepareToPlay(int channels, int maximumStutterSize, int maxIndex);
-    void process(juce::AudioBuffer<float>& buffer);
+    //the longest loop the history holds right now, a longer duration is cut to it. goes up as the history grows
+    int getMaxLoopLength() const { return maxLoopLength.load(std::memory_order_relaxed); }
 
-    void setStutterDurationInSamples(int numSamples);
-    int getStutterDuration() { return maxStutterIndex; }
+    //allocates the storage for up to channels and maximumStutterSize, so preparing within that does not allocate
+    virtual void reserve(int channels, int maximumStutterSize) = 0;
+    virtual void prepareToPlay(int channels, int maximumStutterSize, int maxIndex) = 0;
+
+    //queues a trigger, release, recapture, duration or ratio change for the next process call.
+    //commands have to come from a single thread, in the order of their sample offsets
+    bool postCommand(const StutterCommand& command) { return commandQueue.push(command); }
+
+    int getStutterDuration() { return int(durationSmoother.getTargetValue()); }
 
     void setStutterRepeats(float repeats);
-    int getStutterRepeats() { return stutterRepeats; }
-    void setStutterState(bool state) { stutterState.set(state); }
+    int getStutterRepeats() { return int(repeatsSmoother.getTargetValue()); }
+
+    double getRatio() { return ratioSmoother.getTargetValue(); }
+
+    //plays ratios != 1 through a band limited sinc instead of the compiled in kernel
+    void setHighQuality(bool shouldUseHighQuality) { highQuality.store(shouldUseHighQuality); }
+    bool isHighQuality() const { return highQuality.load(); }
+
+    //per sample values for the next process call that take over from the ramps, nullptr leaves a parameter unmodulated
+    void setModulation(const float* duration, const float* repeats, const float* playbackRatio);
+
+    void setFadeShape(FadeShape shape) { fadeShape.store(shape); }
+    FadeShape getFadeShape() const { return fadeShape.load(); }
+
+    //plays the main stutter as a cloud of short grains from the newest input instead of a loop, note voices keep looping.
+    //the grains follow the playback ratio, the rest of the cloud is set here and read at the start of every quantum
+    void setGranular(bool shouldBeGranular) { granular.store(shouldBeGranular); }
+    bool isGranular() const { return granular.load(); }
+    void setGrainDensity(float grainsPerSecond) { grainDensity.store(grainsPerSecond); }
+    void setGrainLength(float numSamples) { grainLength.store(numSamples); }
+    void setGrainSpray(float numSamples) { grainSpray.store(numSamples); }
+    void setGrainPitchSpread(float semitones) { grainPitchSpread.store(semitones); }
 
-    void setRatio(float playbackRatio);
-    double getRatio() { return ratio; }
+    //one of GrainWindows::Shape, or GrainWindows::numShapes for a random window per grain
+    void setGrainWindow(int window) { grainWindow.store(window); }
+
+    //grains that were dropped since the last call because their quantum had used up its budget
+    int takeNumDroppedGrains() { return numDroppedGrains.exchange(0); }
 
     //getter and setter of original values of parameters that have to be set when changing the parameters via lfo
     int getOrigDuration() { return origDuration; }
@@ -38,43 +135,224 @@ public:
     double getOrigRatio() { return origRatio; }
     void setOrigRatio(double ratio) { origRatio = ratio; }
 
+   #if GLITCH_INSTRUMENTATION
+    //the monitor the ring write, capture, resample, fade and grain stages are timed into, nullptr leaves them untimed
+    void setPerformanceMonitor(PerformanceMonitor* monitor) { performanceMonitor = monitor; }
+   #endif
+
+protected:
+    //only changed by commands, which are applied on the audio thread
+    StutterCommandQueue commandQueue;
+
+    //ramps for the loop parameters, the stutter buffer reads them at the start of each quantum
+    BlockSmoothedValue durationSmoother;
+    BlockSmoothedValue repeatsSmoother{ 5.0f };
+    BlockSmoothedValue ratioSmoother{ 1.0f };
+
+    //set by the lfo for one block at a time
+    const float* durationModulation{ nullptr };
+    const float* repeatsModulation{ nullptr };
+    const float* ratioModulation{ nullptr };
+
+    //used to modify parameters with an LFO object. the processor only sets the ratio when it is far enough from 0,
+    //so these start at values that are safe to post before it first does
+    int origDuration{ 0 };
+    int origRepeats{ 5 };
+    double origRatio{ 1.0 };
+
+    std::atomic<FadeShape> fadeShape{ Linear };
+    std::atomic<bool> highQuality{ false };
+    std::atomic<bool> snapToOnset{ false };
+
+    std::atomic<bool> granular{ false };
+    std::atomic<float> grainDensity{ 100.0f };
+    std::atomic<float> grainLength{ 2205.0f };
+    std::atomic<float> grainSpray{ 0.0f };
+    std::atomic<float> grainPitchSpread{ 0.0f };
+    std::atomic<int> grainWindow{ GrainWindows::Hann };
+    std::atomic<int> numDroppedGrains{ 0 };
+    double sampleRate{ 44100.0 };
+
+    //the audio thread hands every onset it finds to readOnsets
+    void publishOnset(juce::int64 position)
+    {
+        const auto scope = onsetFifo.write(1);
+        if (scope.blockSize1 > 0) onsetPositions[size_t(scope.startIndex1)] = position;
+    }
+
+    static constexpr int onsetFifoSize = 256;
+    juce::AbstractFifo onsetFifo{ onsetFifoSize };
+    std::array<juce::int64, onsetFifoSize> onsetPositions;
+
+    int linkGroup{ 0 };
+    juce::int64 blockPosition{ 0 };
+    int maximumBlockSize{ 4096 };
+
+    int historyLength{ 0 };
+    size_t historyMemoryBudget{ 64 * 1024 * 1024 };
+    std::atomic<int> maxLoopLength{ 0 };
+
+   #if GLITCH_INSTRUMENTATION
+    PerformanceMonitor* performanceMonitor{ nullptr };
+   #endif
+};
+
+//loops a frozen window of its input, in float or double
+template <typename SampleType>
+class StutterBuffer : public StutterBufferBase,
+                      private juce::TimeSliceClient
+{
+public:
+    StutterBuffer();
+    ~StutterBuffer() override;
+
+    void reserve(int channels, int maximumStutterSize) override;
+    void prepareToPlay(int channels, int maximumStutterSize, int maxIndex) override;
+    void changeLinkGroup(int group) override;
+    void setHistoryLength(int numSamples) override;
+    void process(juce::AudioBuffer<SampleType>& buffer);
+
 private:
-    juce::AudioBuffer<float> ringBuffer;
-    juce::AudioBuffer<float> stutterBuffer;
+    //the ring, fade curves, crossfade and voice buffers, carved out again on every prepareToPlay
+    AudioArena arena;
+
+    //the ring starts out holding this many loops of the maximum size, and can grow to maxHistoryInStutters of them
+    static constexpr int ringSizeInStutters = 4;
+    static constexpr int maxHistoryInStutters = 30;
+    juce::SharedResourcePointer<HistoryGrowthThread> growthThread;
+
+    //channel interleaved, so capture and playback handle a whole group of channels per vector
+    ChannelGroupBuffer<SampleType> ringBuffer;
+
+    //a shared history can not stop its writer for one instance's loop, so it holds a loop of the maximum size
+    //repeated ten times and one more loop of room for instances that run ahead
+    static constexpr int linkedRingSizeInStutters = 12;
 
-    juce::Atomic<bool> copyStutterToggle{ false };
-    juce::Atomic<bool> stutterState{ false }; 
+    //the history of the link group, kept alive by the message thread. the audio thread reads through sharedHistory,
+    //which is null while the instance uses its own ring. a ring the instance was prepared without grows from nothing
+    juce::SharedResourcePointer<typename SharedStutterHistory<SampleType>::Registry> historyRegistry;
+    typename SharedStutterHistory<SampleType>::Ptr attachedHistory;
+    SharedStutterHistory<SampleType>* sharedHistory{ nullptr };
+    int maximumStutterLength{ 0 };
 
-    //TODO: set with apvts parameters
+    //changeLinkGroup hands the new history over through pendingHistory and bumps historyVersion after it.
+    //the histories the audio thread let go of are released once it has acknowledged the version that replaced them
+    std::atomic<SharedStutterHistory<SampleType>*> pendingHistory{ nullptr };
+    std::atomic<int> historyVersion{ 0 };
+    std::atomic<int> acknowledgedHistoryVersion{ 0 };
+    int adoptedHistoryVersion{ 0 };
+    juce::ReferenceCountedArray<SharedStutterHistory<SampleType>> retiredHistories;
+
+    //timeline position of the next sample
+    juce::int64 streamPosition{ 0 };
+    //a linked instance reads its loops the longest block behind its own position, which the writer has passed whether it ran
+    //before or after this instance. so all of them capture the same windows, and the windows do not depend on the block size
+    int linkedReadBehind{ 0 };
+    juce::int64 getLinkedHistoryEnd(juce::int64 position) const { return juce::jmin(position - linkedReadBehind, sharedHistory->getWrittenEnd()); }
     int ringWriteIndex{ 0 };
-    int stutterReadIndex{ 0 }; 
-    float maxStutterIndex{ 0 };
-    float stutterRepeats{ 5 };
-    int currentRepeat{ 0 };
-    float ratio{ 1.0f };
-
-    //used to store target values when ramping parameters
-    float targetDuration;
-    float targetRepeats;
-    float targetRatio;
-
-    //used to store an increment to use when ramping the parameters
-    float durRampIncrement;
-    float repeatsRampIncrement;
-    float ratioRampIncrement;
-
-    //used to modify parameters with an LFO object
-    int origDuration;
-    int origRepeats;
-    double origRatio;
+
+    //one read head over the history. every voice loops a frozen window of the ring buffer and captures a new one before the writer
+    //comes round to it. it reaches back minCaptureLength, or further for a loop that is longer and as far as half the ring allows.
+    //a trigger can ask for it to start lookback samples back instead, so it ends before the newest input
+    struct Voice
+    {
+        int id{ 0 };
+        bool active{ false };
+        juce::int64 order{ 0 };
+
+        bool frozen{ false };
+        int captureStartIndex{ 0 };
+        juce::int64 captureStartPosition{ 0 };
+        int captureLength{ 0 };
+        int lookback{ 0 };
+
+        int readIndex{ 0 };
+        int currentRepeat{ 0 };
+
+        //the main voice takes these from the ramps at every quantum, the others keep the ones they were triggered with
+        float duration{ 0.0f };
+        float loopLength{ 0.0f };
+        float repeats{ 5.0f };
+        float ratio{ 1.0f };
+    };
+
+    //voice 0 is the main voice, the others are taken by triggers for other ids and stolen oldest first once all are in use.
+    //all voices are summed, the input only passes through while none is active
+    static constexpr int maxVoices = 8;
+    std::array<Voice, maxVoices> voices;
+    Voice& mainVoice{ voices[0] };
+    juce::int64 nextVoiceOrder{ 0 };
+    int minCaptureLength{ 0 };
+
+    //onsets of the input, found in the ring as it is written. they count the samples written into the own ring,
+    //or are timeline positions while linked
+    OnsetDetector<SampleType> onsetDetector;
+    HistoryIndex onsets;
+    juce::int64 writtenPosition{ 0 };
+    juce::int64 markedEnd{ std::numeric_limits<juce::int64>::min() };
+
+    //audio is processed in quanta of quantumSize samples on a grid that runs across host blocks.
+    //the parameters above only change at the start of a quantum, every other event happens at its exact sample,
+    //so the output does not depend on the host block size
+    static constexpr int quantumSize = 32;
+    static constexpr int rampLength = 16 * quantumSize;
+    int quantumPosition{ 0 };
 
     const int numFadeSamples{ 500 };
 
-    void pushBuffer(juce::AudioBuffer<float>& buf);
-    void copyStutter();
-    float getInterpolatedSample(int channel, int currentIndex);
-    bool anyParameterUpdated(int numSamples);
-    void rampParameters();
-    void applyFade();
-    float getCrossfadeSample(int chan, int index, float sample);
-};
\ No newline at end of file
+    //a ratio modulated through 0 would step endlessly far through the loop per sample, every ratio is kept at least this far from 0
+    static constexpr float minRatio = 1.0f / 16.0f;
+    static_assert(1.0f / minRatio <= float(ResamplerKernels::BandLimitedSincTables::maxStep), "the high quality resampler filters every step a ratio can take");
+
+    //gain curves for every fade shape, laid out shape after shape and built in prepareToPlay
+    SampleType* fadeInCurves{ nullptr };
+    SampleType* fadeOutCurves{ nullptr };
+
+    //holds the head of the loop while it is crossfaded into the tail, refers to channels in the arena
+    SampleType* crossfadeChannels[maxNumChannels]{};
+    juce::AudioBuffer<SampleType> crossfadeBuffer;
+
+    //every voice after the first is rendered here and added to the output, one quantum at most
+    SampleType* voiceChannels[maxNumChannels]{};
+    juce::AudioBuffer<SampleType> voiceBuffer;
+
+    StutterResampler resampler;
+    HighQualityResampler highQualityResampler;
+
+    //plays in place of the loop of the main voice while granularQuantum is set, which follows granular at every quantum
+    GrainCloud<SampleType> grainCloud;
+    typename GrainCloud<SampleType>::Settings grainSettings;
+    bool granularQuantum{ false };
+
+    size_t getArenaSize(int channels, int maximumStutterSize) const;
+    int useTimeSlice() override;
+    void adoptPendingHistory();
+    void processSegment(juce::AudioBuffer<SampleType>& buffer, int segmentStart, int numSamples);
+    void processSlice(juce::AudioBuffer<SampleType>& slice);
+    void handleCommand(const StutterCommand& command);
+    void pushBuffer(juce::AudioBuffer<SampleType>& buf);
+    void markOnsets(const ChannelGroupBuffer<SampleType>& ring, int ringIndex, int numSamples, juce::int64 position, juce::int64 timelinePosition);
+    Voice* findVoice(int id);
+    Voice& startVoice(int id);
+    bool hasActiveVoice() const;
+    void stopVoice(Voice& voice);
+    void captureStutter(Voice& voice);
+    //true if the writer reaches the window of the voice within the next numSamples
+    bool isCaptureOverwritten(const Voice& voice, int numSamples) const;
+    //loops reach back at least minCaptureLength, longer ones as far as half of the history
+    int getMaxReach(int historySize) const { return juce::jmax(minCaptureLength, historySize / 2); }
+    //an own ring that is growing again after an unlink starts out smaller than the shortest loop needs.
+    //until it holds two of them the voices stay silent, like they do while it is empty
+    bool hasRoomForLoop(int historySize) const { return historySize >= 2 * minCaptureLength; }
+    void updateMaxLoopLength();
+    ResamplerSource<SampleType> getCaptureSource(const Voice& voice) const;
+    juce::int64 renderCapture(const Voice& voice, juce::AudioBuffer<SampleType>& dest, int destStart, int loopIndex, int numSamples);
+    static float limitRatio(float ratio);
+    void startQuantum(int blockOffset);
+    void buildFadeCurves();
+    bool playsGrains(const Voice& voice) const { return granularQuantum && &voice == &mainVoice; }
+    void renderVoiceSpan(const Voice& voice, juce::AudioBuffer<SampleType>& buffer, int startSample, int numSamples);
+    void renderLoopSpan(const Voice& voice, juce::AudioBuffer<SampleType>& buffer, int startSample, int numSamples);
+    void renderGrains(juce::AudioBuffer<SampleType>& buffer, int startSample, int numSamples);
+    void applyFade(const Voice& voice, juce::AudioBuffer<SampleType>& buffer, int startSample, int numSamples);
+};
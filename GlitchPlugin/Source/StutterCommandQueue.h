@@ -0,0 +1,68 @@
+/*
+  ==============================================================================
+
+    StutterCommandQueue.h
+    Created: 17 Oct 2026 11:48:05am
+    Author:  laura
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+//a change to the stutter that takes effect at a sample offset inside the next processed block
+struct StutterCommand
+{
+    enum Type
+    {
+        Trigger,
+        Release,
+        Recapture,
+        SetDuration,
+        SetRatio
+    };
+
+    Type type;
+    int sampleOffset{ 0 };
+    //duration in samples for SetDuration, playback ratio for SetRatio.
+    //for Trigger and Recapture how many samples before the command the loop starts, 0 starts it a loop length back
+    float value{ 0.0f };
+
+    //the voice Trigger, Release and Recapture act on, 0 is the main voice that follows the parameters.
+    //any other id plays with the duration in samples and ratio it was triggered with, Release with -1 stops all of those
+    int voice{ 0 };
+    float duration{ 0.0f };
+    float ratio{ 1.0f };
+};
+
+//single producer, single consumer fifo of stutter commands, neither side locks or allocates.
+//commands are handed over in the order they were pushed, so the producer has to push them sorted by sampleOffset
+class StutterCommandQueue
+{
+public:
+    static constexpr int capacity = 256;
+
+    //returns false if the queue is full and the command was dropped
+    bool push(const StutterCommand& command)
+    {
+        const auto scope = fifo.write(1);
+        if (scope.blockSize1 + scope.blockSize2 == 0) return false;
+
+        commands[scope.blockSize1 > 0 ? scope.startIndex1 : scope.startIndex2] = command;
+        return true;
+    }
+
+    bool pop(StutterCommand& command)
+    {
+        const auto scope = fifo.read(1);
+        if (scope.blockSize1 + scope.blockSize2 == 0) return false;
+
+        command = commands[scope.blockSize1 > 0 ? scope.startIndex1 : scope.startIndex2];
+        return true;
+    }
+
+private:
+    juce::AbstractFifo fifo{ capacity };
+    std::array<StutterCommand, capacity> commands;
+};